@@ -0,0 +1,244 @@
+#ifndef AGGREGATEAVL_H
+#define AGGREGATEAVL_H
+
+#include <functional>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also stores the combined values of its whole subtree.
+*/
+template <typename Key, typename Value>
+class AggregateAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AggregateAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+        : AVLNode<Key, Value>(key, value, parent), aggregate_(value) { }
+
+    const Value& getAggregate() const { return aggregate_; }
+    void setAggregate(const Value& aggregate) { aggregate_ = aggregate; }
+    void swapAggregate(AggregateAVLNode<Key, Value>* other) { std::swap(aggregate_, other->aggregate_); }
+
+private:
+    Value aggregate_;
+};
+
+/**
+* An AVLTree whose nodes keep combine() of every value in their subtree, so the
+* combination over any key range takes O(log n) instead of a scan:
+*
+*   AggregateAVLTree<int, long> bytes;                        // sums
+*   AggregateAVLTree<int, int, MaxOf> worst(INT_MIN);         // maxima
+*   long window = bytes.aggregate(from, to);
+*
+* combine must be associative and identity its neutral element; it need not be
+* commutative, values are combined in key order. Aggregates are kept current
+* by the rotations, insert/remove fix-ups, node swaps, split/join and rebuilds
+* of AVLTree, and by every method that sets a value (insert, insert_or_assign,
+* upsert). Values must not be written through iterators; tryGet and
+* operator[] only hand out const access, and getOrCreate is not available.
+* Lazily deleted nodes count as identity. verify() also checks every stored
+* aggregate, so Value needs operator==.
+*/
+template <typename Key, typename Value, typename Combine = std::plus<Value> >
+class AggregateAVLTree : public AVLTree<Key, Value>
+{
+public:
+    explicit AggregateAVLTree(const Value& identity = Value(), Combine combine = Combine());
+
+    // combine() of the values of every key with lo <= key < hi, identity if none
+    Value aggregate(const Key& lo, const Key& hi) const;
+    // combine() of every value in the tree
+    Value total() const;
+
+    const Value* tryGet(const Key& key) const { return BinarySearchTree<Key, Value>::tryGet(key); }
+    const Value& operator[](const Key& key) const { return BinarySearchTree<Key, Value>::operator[](key); }
+    // AVLTree::split/join, limited to trees whose nodes carry aggregates
+    void split(const Key& key, AggregateAVLTree<Key, Value, Combine>& right) { AVLTree<Key, Value>::split(key, right); }
+    void join(AggregateAVLTree<Key, Value, Combine>& right) { AVLTree<Key, Value>::join(right); }
+    virtual void rebalance();
+
+protected:
+    typedef AggregateAVLNode<Key, Value> AggNode;
+
+    virtual AVLNode<Key, Value>* newNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void refreshNode(AVLNode<Key, Value>* n);
+    virtual void refreshPath(AVLNode<Key, Value>* n);
+    virtual void itemChanged(Node<Key, Value>* n);
+    virtual void nodesSwapped(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void rebuildFrom(std::vector<Node<Key, Value>*>& nodes);
+    virtual size_t nodeFootprint() const { return sizeof(AggNode); }
+    virtual const char* verifyNode(Node<Key, Value>* n, int leftHeight, int rightHeight) const;
+    virtual const char* verifyNodeLocal(Node<Key, Value>* n) const;
+
+private:
+    // would hand out a writable value the aggregates cannot follow
+    using BinarySearchTree<Key, Value>::getOrCreate;
+
+    const Value& own(const Node<Key, Value>* n) const;
+    const Value& subtree(const Node<Key, Value>* n) const;
+    const char* verifyAggregate(const Node<Key, Value>* n) const;
+    void refreshAll(AVLNode<Key, Value>* n);
+
+    Value identity_;
+    Combine combine_;
+};
+
+template <typename Key, typename Value, typename Combine>
+AggregateAVLTree<Key, Value, Combine>::AggregateAVLTree(const Value& identity, Combine combine)
+    : identity_(identity), combine_(combine)
+{
+}
+
+/**
+* Finds the highest node inside [lo, hi), then walks down both of its sides:
+* on the way to lo every node in range brings itself and its right subtree, on
+* the way to hi itself and its left subtree. Two O(log n) paths in all.
+*/
+template <typename Key, typename Value, typename Combine>
+Value AggregateAVLTree<Key, Value, Combine>::aggregate(const Key& lo, const Key& hi) const
+{
+    Node<Key, Value>* top = this->root_;
+    while(top != NULL) {
+        BST_STAT(++this->stats_.keyComparisons);
+        if(top->getKey() < lo) {
+            top = top->getRight();
+        }
+        else if(!(top->getKey() < hi)) {
+            top = top->getLeft();
+        }
+        else {
+            break;
+        }
+    }
+    if(top == NULL) {
+        return identity_;
+    }
+    Value below = identity_;  // keys in [lo, top)
+    for(Node<Key, Value>* n = top->getLeft(); n != NULL; ) {
+        BST_STAT(++this->stats_.keyComparisons);
+        if(n->getKey() < lo) {
+            n = n->getRight();
+        }
+        else {
+            below = combine_(combine_(own(n), subtree(n->getRight())), below);
+            n = n->getLeft();
+        }
+    }
+    Value above = identity_;  // keys in (top, hi)
+    for(Node<Key, Value>* n = top->getRight(); n != NULL; ) {
+        BST_STAT(++this->stats_.keyComparisons);
+        if(!(n->getKey() < hi)) {
+            n = n->getLeft();
+        }
+        else {
+            above = combine_(above, combine_(subtree(n->getLeft()), own(n)));
+            n = n->getRight();
+        }
+    }
+    return combine_(combine_(below, own(top)), above);
+}
+
+template <typename Key, typename Value, typename Combine>
+Value AggregateAVLTree<Key, Value, Combine>::total() const
+{
+    return subtree(this->root_);
+}
+
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::rebalance()
+{
+    AVLTree<Key, Value>::rebalance();
+    refreshAll(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
+
+template <typename Key, typename Value, typename Combine>
+AVLNode<Key, Value>* AggregateAVLTree<Key, Value, Combine>::newNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AggNode(key, value, parent);
+}
+
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::refreshNode(AVLNode<Key, Value>* n)
+{
+    static_cast<AggNode*>(n)->setAggregate(combine_(combine_(subtree(n->getLeft()), own(n)), subtree(n->getRight())));
+}
+
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::refreshPath(AVLNode<Key, Value>* n)
+{
+    for(; n != NULL; n = n->getParent()) {
+        refreshNode(n);
+    }
+}
+
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::itemChanged(Node<Key, Value>* n)
+{
+    refreshPath(static_cast<AVLNode<Key, Value>*>(n));
+}
+
+// Each position keeps the aggregate of its subtree, which a swap does not change
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::nodesSwapped(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    static_cast<AggNode*>(n1)->swapAggregate(static_cast<AggNode*>(n2));
+}
+
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::rebuildFrom(std::vector<Node<Key, Value>*>& nodes)
+{
+    AVLTree<Key, Value>::rebuildFrom(nodes);
+    refreshAll(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
+
+template <typename Key, typename Value, typename Combine>
+const Value& AggregateAVLTree<Key, Value, Combine>::own(const Node<Key, Value>* n) const
+{
+    return n->isDeleted() ? identity_ : n->getValue();
+}
+
+template <typename Key, typename Value, typename Combine>
+const Value& AggregateAVLTree<Key, Value, Combine>::subtree(const Node<Key, Value>* n) const
+{
+    return n == NULL ? identity_ : static_cast<const AggNode*>(n)->getAggregate();
+}
+
+template <typename Key, typename Value, typename Combine>
+const char* AggregateAVLTree<Key, Value, Combine>::verifyNode(Node<Key, Value>* n, int leftHeight, int rightHeight) const
+{
+    const char* error = AVLTree<Key, Value>::verifyNode(n, leftHeight, rightHeight);
+    return error != NULL ? error : verifyAggregate(n);
+}
+
+template <typename Key, typename Value, typename Combine>
+const char* AggregateAVLTree<Key, Value, Combine>::verifyNodeLocal(Node<Key, Value>* n) const
+{
+    const char* error = AVLTree<Key, Value>::verifyNodeLocal(n);
+    return error != NULL ? error : verifyAggregate(n);
+}
+
+// n's stored aggregate must be what refreshNode would compute from its children
+template <typename Key, typename Value, typename Combine>
+const char* AggregateAVLTree<Key, Value, Combine>::verifyAggregate(const Node<Key, Value>* n) const
+{
+    if(!(subtree(n) == combine_(combine_(subtree(n->getLeft()), own(n)), subtree(n->getRight())))) {
+        return "stored aggregate does not match the subtree";
+    }
+    return NULL;
+}
+
+// Recomputes every aggregate below n bottom-up, after a rebuild. O(n).
+template <typename Key, typename Value, typename Combine>
+void AggregateAVLTree<Key, Value, Combine>::refreshAll(AVLNode<Key, Value>* n)
+{
+    if(n == NULL) {
+        return;
+    }
+    refreshAll(n->getLeft());
+    refreshAll(n->getRight());
+    refreshNode(n);
+}
+
+#endif
@@ -6,7 +6,10 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 #include "bst.h"
+#include "avlcore.h"
 
 struct KeyError { };
 
@@ -100,7 +103,7 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
@@ -135,459 +138,627 @@ class AVLTree : public BinarySearchTree<Key, Value>
 public:
     virtual void insert (const std::pair<const Key, Value> &new_item);
     virtual void remove(const Key& key);  
+    virtual void rebalance();
+    virtual void setScapegoat(bool enabled, double alpha = 0.75);
+    template <typename InputIt>
+    void assignSorted(InputIt first, InputIt last);
+    size_t eraseRange(const Key& lo, const Key& hi);
+    template <typename Predicate>
+    size_t eraseIf(Predicate pred);
+    void split(const Key& key, AVLTree<Key, Value>& right);
+    void join(AVLTree<Key, Value>& right);
 protected:
-    virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
-		
+    virtual size_t nodeFootprint() const { return sizeof(AVLNode<Key, Value>); }
+    virtual void removeNode(Node<Key, Value>* n);
+    virtual Node<Key, Value>* insertOrFind(const Key& key, const Value& value, bool& inserted);
+    virtual void rebuildFrom(std::vector<Node<Key, Value>*>& nodes);
+    virtual const char* verifyNode(Node<Key, Value>* n, int leftHeight, int rightHeight) const;
+    virtual const char* verifyNodeLocal(Node<Key, Value>* n) const;
+    // Augmentation hooks for derived trees that keep per-subtree data:
+    // newNode allocates every node, refreshNode recomputes n from its children
+    // after a relink, refreshPath does so for n and all its ancestors, and
+    // nodesSwapped follows a swap of two nodes' positions
+    virtual AVLNode<Key, Value>* newNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void refreshNode(AVLNode<Key, Value>* /*n*/) { }
+    virtual void refreshPath(AVLNode<Key, Value>* /*n*/) { }
+    virtual void nodesSwapped(AVLNode<Key, Value>* /*n1*/, AVLNode<Key, Value>* /*n2*/) { }
+
+    /**
+    * The view of this tree AVLAlgorithms rebalances: links through AVLNode
+    * pointers, and hooks that count into the stats and call the augmentation
+    * hooks above, so the insert/remove fix-ups exist once, in avlcore.h.
+    */
+    struct Links
+    {
+        typedef AVLNode<Key, Value>* NodeRef;
+
+        explicit Links(AVLTree<Key, Value>& t) : tree(t) { }
+
+        NodeRef nil() const { return NULL; }
+        NodeRef getRoot() const { return static_cast<NodeRef>(tree.root_); }
+        void setRoot(NodeRef n) { tree.root_ = n; }
+        NodeRef getParent(NodeRef n) const { return n->getParent(); }
+        NodeRef getLeft(NodeRef n) const { return n->getLeft(); }
+        NodeRef getRight(NodeRef n) const { return n->getRight(); }
+        void setParent(NodeRef n, NodeRef p) { n->setParent(p); }
+        void setLeft(NodeRef n, NodeRef l) { n->setLeft(l); }
+        void setRight(NodeRef n, NodeRef r) { n->setRight(r); }
+        int8_t getBalance(NodeRef n) const { return n->getBalance(); }
+        void setBalance(NodeRef n, int8_t b) { n->setBalance(b); }
+
+        static void linked(Links& t, NodeRef n) { t.tree.noteInserted(n); t.tree.refreshPath(n); }
+        static void unlinked(Links& t, NodeRef parent) { t.tree.refreshPath(parent); }
+        static void rotated(Links& t, NodeRef lower, NodeRef upper) { t.tree.refreshNode(lower); t.tree.refreshNode(upper); }
+        static void swapped(Links& t, NodeRef n1, NodeRef n2) { t.tree.nodesSwapped(n1, n2); }
+        static void rebalanced(Links& t, bool twice) { BST_STAT(twice ? ++t.tree.stats_.doubleRotations : ++t.tree.stats_.singleRotations); }
+        static void removefixStep(Links& t) { BST_STAT(++t.tree.stats_.removefixSteps); }
+
+        AVLTree<Key, Value>& tree;
+    };
+    typedef AVLAlgorithms<Links, Links> Balancer;
+
     // Add helper functions here
-		void rotateright(AVLNode <Key,Value>* n);
-		void rotateleft(AVLNode <Key,Value>* n);
-		void insertfix( AVLNode <Key,Value>* p , AVLNode <Key,Value>* n );
-		void removefix( AVLNode <Key,Value>* p , int8_t difference );
+		int resetbalances( AVLNode <Key,Value>* n );
+
+		// split/join on detached subtrees; h arguments are subtree heights (0 for NULL)
+		static int heightOf(AVLNode<Key, Value>* n);
+		int link(AVLNode<Key, Value>* n, AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* right, int hr);
+		AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h);
+		AVLNode<Key, Value>* joinRight(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h);
+		AVLNode<Key, Value>* joinLeft(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h);
+		AVLNode<Key, Value>* joinTrees(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* right, int hr, int& h);
+		AVLNode<Key, Value>* extractMin(AVLNode<Key, Value>* t, int ht, int& h, AVLNode<Key, Value>*& min);
+		void splitNodes(AVLNode<Key, Value>* t, int ht, const Key& key,
+		                AVLNode<Key, Value>*& left, int& hl, AVLNode<Key, Value>*& right, int& hr);
 
 };
 
 
+/*
+ * Recall: If key is already in the tree, you should 
+ * overwrite the current value with the updated value.
+ */
 template<class Key, class Value>
-void AVLTree<Key, Value>::rotateright (AVLNode <Key,Value>* n)
+void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 {
-	AVLNode<Key, Value>* nleft = n->getLeft();
-	AVLNode<Key, Value>* nparent = n->getParent();
-	if ( nparent != NULL ) { //need to check if nparent is NULL, which means n is root
-		if ( nparent->getRight() == n ) { //if n is right child of nparent
-			nparent->setRight(nleft);
-		}
-		else { //if n is left child of nparent
-			nparent->setLeft(nleft);
-		}
+	bool inserted;
+	Node<Key, Value>* node = this->insertOrFindLive(new_item.first, new_item.second, inserted);
+	if ( !inserted ) {
+		node->setValue(new_item.second);
+		this->itemChanged(node);
 	}
-	else { //set nleft to the new root_
-		this->root_ = nleft;
-	}
-	nleft->setParent(nparent); //setting child of n to nparent
-	n->setParent(nleft);
-	AVLNode<Key, Value>* nleft_right = nleft->getRight(); 
-	if ( nleft_right != NULL ) {//if left child has a right child
-		nleft_right->setParent(n);
-	}
-	n->setLeft(nleft_right);
-	nleft->setRight(n);	
 }
 
-
+/*
+ * The single descent behind insert, insert_or_assign, upsert and getOrCreate
+ * (see BinarySearchTree::insertOrFind); the new node is linked in and the
+ * balances fixed by AVLAlgorithms::link.
+ */
 template<class Key, class Value>
-void AVLTree<Key, Value>::rotateleft (AVLNode <Key, Value>* n )
+Node<Key, Value>* AVLTree<Key, Value>::insertOrFind(const Key& currentkey, const Value& replace, bool& inserted)
 {
-	AVLNode<Key, Value>* nright = n->getRight();
-	AVLNode<Key, Value>* nparent = n->getParent();
-	if ( nparent != NULL ) { //need to check if nparent is NULL, meaning n is root
-		if ( nparent->getRight() == n ) { //if n is right child of nparent
-			nparent->setRight(nright);
-		}
-		else { //if n is left child of nparent
-			nparent->setLeft(nright);
+	AVLNode<Key, Value>* parent = NULL;
+	AVLNode<Key, Value>* bstiter = static_cast<AVLNode<Key, Value>*>(this->root_);
+	bool left = false;
+	while ( bstiter != NULL ) {
+		BST_STAT(++this->stats_.keyComparisons);
+		const Key& checkerkey = bstiter->getKey();
+		if ( currentkey == checkerkey ) { //key already in the tree
+			inserted = false;
+			return bstiter;
 		}
+		parent = bstiter;
+		left = currentkey < checkerkey;
+		bstiter = left ? bstiter->getLeft() : bstiter->getRight();
 	}
-	else { //set nright to the new root_
-		this->root_ = nright;
-	}
-	nright->setParent(nparent); //setting child of n to nparent
-	n->setParent(nright);
-	AVLNode<Key, Value>* nright_left = nright->getLeft();
-	if ( nright_left != NULL ) { //if right child has a left child
-		nright_left->setParent(n);
-	}
-	n->setRight(nright_left);
-	nright->setLeft(n);
-
-
+	inserted = true;
+	AVLNode<Key, Value>* addnode = newNode(currentkey, replace, parent);
+	++this->size_;
+	Links links(*this);
+	Balancer::link(links, parent, addnode, left);
+	return addnode;
 }
 
 
-
+/*
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
+ */
 template<class Key, class Value>
-void AVLTree<Key, Value>::insertfix( AVLNode <Key,Value>* p , AVLNode <Key,Value>* n ) 
+void AVLTree<Key, Value>:: remove(const Key& key)
 {
-	if ( p == NULL  || p->getParent() == NULL ) {
-		return;
-	}
-	AVLNode<Key, Value>* pparent = p->getParent();
-	if ( pparent->getRight() == p ) { //if p is right child of pparent
-		pparent->updateBalance(1); //setting new balance
-		if (pparent->getBalance() == 0 ) { //if pparent balance is 0, the tree is balanced
-			return;
-		}
-		else if ( pparent->getBalance() == 1 ) { //if pparent balance is 1, recurse through to balance tree
-			insertfix(pparent, p);
-		}
-		else { //if pparent balance is 2 , rotate nodes
-			if ( p->getRight() == n ) { //then zig-zig, means nodes are in straight direction
-				rotateleft(pparent);
-				pparent->setBalance(0);
-				p->setBalance(0);
-				return;
+			if ( this->root_ != NULL) {
+			AVLNode<Key, Value> *remover = (AVLNode<Key, Value>*)this->root_;
+			while ( true ) {
+			BST_STAT(++this->stats_.keyComparisons);
+			Key check = remover->getKey();
+			if ( check == key ) { //if we found the key
+				this->removeFound(remover);
+				break;
 			}
-			else { //zig-zag
-				rotateright(p);
-				rotateleft(pparent);
-				int8_t nbalance = n->getBalance();
-				//checking child balance to see what the new rotated nodes balances will become
-				if ( nbalance == 1 ) { 
-						p->setBalance(0);
-						pparent->setBalance(-1);
-						n->setBalance(0);
-				}
-				else if ( nbalance == 0 ) {
-					p->setBalance(0);
-					pparent->setBalance(0);
-					n->setBalance(0);
-				}
-				else if ( nbalance == -1 ) {
-					p->setBalance(1);
-					pparent->setBalance(0);
-					n->setBalance(0);
+			else if ( key < check ) { //if the current key  node is less than remover key
+				if ( remover->getLeft() == NULL ) {
+					break;
 				}
-				return;
-			}
-		}
-	}
-	else if ( pparent->getLeft() == p ) { //if p is left child of pparent
-		pparent->updateBalance(-1); //setting new balance
-		if (pparent->getBalance() == 0 ) {
-			return;
-		}
-		else if ( pparent->getBalance() == -1 ) { //if pparent balance is -1, recurse through to balance tree
-			insertfix(pparent, p);
-		}
-		else { //if pparent balance is -2 , rotate nodes
-			if ( p->getLeft() == n ) { //then zig-zig
-				rotateright(pparent);
-				p->setBalance(0);
-				pparent->setBalance(0);
-				return;
+				remover = remover->getLeft();
 			}
-			else { //then zig-zag
-				rotateleft(p);//goes here
-				rotateright(pparent);
-				int8_t nbalance = n->getBalance();
-				//checking child balance to see what the new rotated nodes balances will become
-				if ( nbalance == -1 ) {
-						p->setBalance(0);
-						pparent->setBalance(1);
-						n->setBalance(0);
-				}
-				else if ( nbalance == 0 ) {
-					p->setBalance(0);
-					pparent->setBalance(0);
-					n->setBalance(0);
-				}
-				else if ( nbalance == 1 ) {
-					p->setBalance(-1);
-					pparent->setBalance(0);
-					n->setBalance(0);
+			else if (key > check){ //if the current key  node is greater than remover key
+				if ( remover->getRight() == NULL ) {
+					break;
 				}
-				return;
+				remover = remover->getRight();
 			}
-		}
+			else { //means no key in tree
+				break;
+			}
+		}	
 	}
 }
 
 /*
- * Recall: If key is already in the tree, you should 
- * overwrite the current value with the updated value.
+ * Unlinks and deletes a node known to be in the tree; AVLAlgorithms::unlink
+ * swaps it with its predecessor if it has two children and runs removefix.
  */
 template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+void AVLTree<Key, Value>::removeNode(Node<Key, Value>* node)
 {
-	Key currentkey = new_item.first; //find out how to access value
-	Value replace = new_item.second;
-	if (this->empty() == false ) {
-		AVLNode<Key, Value>* bstiter = (AVLNode<Key,Value>*)this->root_;
-		while ( true ) {
-			Key checkerkey = bstiter->getKey();
-			if ( currentkey == checkerkey ) { //if the key of the keyvaluepair is equal to current key of location, replace the values
-				bstiter->setValue(replace);
-				break;
-			}
-			else if ( currentkey < checkerkey ) { //if key of keyvaluepair is less than current key of location, move left
-				if ( bstiter->getLeft() == NULL ) { //if the left is NULL, add to the tree
-					AVLNode<Key, Value>* addnode  = new AVLNode<Key, Value>(currentkey , replace , bstiter);
-					bstiter->setLeft(addnode);
-					if ( bstiter->getBalance() == 1 ) { //if balance is 1, adding left node will set it to 0
-						bstiter->setBalance(0);
-					}
-					else if ( bstiter->getBalance() == 0 ) { //if balance is 0, adding left node will set it to -1, then call insert-fix
-						bstiter->setBalance(-1);
-						insertfix( bstiter , addnode );
-					}
-					break;
-				}
-				bstiter = bstiter->getLeft();
-			}
-			else if ( currentkey > checkerkey) { //if key of keyvaluepair is greater than current key of location, go right
-				if ( bstiter->getRight() == NULL ) { //if the right is NULL, add to tree
-					AVLNode<Key, Value>* addnode  = new AVLNode<Key, Value>(currentkey , replace , bstiter);
-					bstiter->setRight(addnode);	
-					if ( bstiter->getBalance() == -1 ) { //if the balance is -1, adding right node will set it to 0
-						bstiter->setBalance(0);
-					}
-					else if ( bstiter->getBalance() == 0 ) { //if balance is 0, adding right node will set it to 1, then call insert-fix
-						bstiter->setBalance(1);
-						
-						insertfix( bstiter , addnode );
-					}
-					break;
-				}
-				bstiter = bstiter->getRight();
+	AVLNode<Key, Value> *remover = static_cast<AVLNode<Key, Value>*>(node);
+	this->noteRemoving(remover);
+	Links links(*this);
+	Balancer::unlink(links, remover);
+	delete remover;
+	--this->size_;
+}
+
+
+/*
+ * Reshapes the tree into a complete tree (see BinarySearchTree::rebalance)
+ * and then recomputes the stored balances to match the new shape.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebalance()
+{
+	BinarySearchTree<Key, Value>::rebalance();
+	resetbalances(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
+
+/*
+ * An AVLTree is balanced by its rotations already, and a scapegoat rebuild
+ * would leave stale balances (and stale per-subtree data in derived trees),
+ * so the mode can only be turned off. Throws std::logic_error otherwise.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::setScapegoat(bool enabled, double alpha)
+{
+	if ( enabled ) {
+		throw std::logic_error("AVLTree balances itself; scapegoat mode is for BinarySearchTree");
+	}
+	BinarySearchTree<Key, Value>::setScapegoat(false, alpha);
+}
+
+/*
+ * Replaces the contents of the tree with the items in [first, last), which
+ * must be in strictly increasing key order (anything with .first/.second).
+ * The balanced tree is linked directly in O(n) instead of doing n inserts.
+ */
+template<class Key, class Value>
+template<typename InputIt>
+void AVLTree<Key, Value>::assignSorted(InputIt first, InputIt last)
+{
+	this->clear();
+	std::vector<Node<Key, Value>*> nodes;
+	for ( ; first != last; ++first ) {
+		if ( !nodes.empty() && !(nodes.back()->getKey() < first->first) ) { //out of order or duplicate key
+			for ( size_t i = 0; i < nodes.size(); ++i ) {
+				delete nodes[i];
 			}
+			throw std::invalid_argument("assignSorted needs strictly increasing keys");
 		}
+		nodes.push_back(newNode(first->first, first->second, NULL));
 	}
-	else {
-		AVLNode<Key, Value>* newroot = new AVLNode<Key, Value>(currentkey, replace, NULL);
-		this->root_ = newroot;
+	rebuildFrom(nodes);
+}
+
+/*
+ * BinarySearchTree::rebuildFrom, then the balances of the new shape.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebuildFrom(std::vector<Node<Key, Value>*>& nodes)
+{
+	BinarySearchTree<Key, Value>::rebuildFrom(nodes);
+	resetbalances(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
+
+/*
+ * Split/join surgery. Subtrees are handled detached from the tree with their
+ * heights passed alongside; a child's height follows from its parent's height
+ * and balance, so no heights are stored. Joining trees whose heights differ by
+ * d costs O(d), and the joins done by one split telescope to O(log n).
+ */
+
+// Height of a subtree by following its taller side down. O(height).
+template<class Key, class Value>
+int AVLTree<Key, Value>::heightOf(AVLNode<Key, Value>* n)
+{
+	int h = 0;
+	while ( n != NULL ) {
+		++h;
+		n = n->getBalance() < 0 ? n->getLeft() : n->getRight();
 	}
+	return h;
 }
 
+// Makes left and right the children of n, sets its balance and returns its height.
+template<class Key, class Value>
+int AVLTree<Key, Value>::link(AVLNode<Key, Value>* n, AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* right, int hr)
+{
+	n->setLeft(left);
+	n->setRight(right);
+	if ( left != NULL ) {
+		left->setParent(n);
+	}
+	if ( right != NULL ) {
+		right->setParent(n);
+	}
+	n->setBalance(hr - hl);
+	refreshNode(n);
+	return 1 + std::max(hl, hr);
+}
 
+// Joins left < k < right into one AVL subtree with k as the connecting node.
 template<class Key, class Value>
-void AVLTree<Key, Value>::removefix( AVLNode <Key,Value>* p , int8_t difference )
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinNodes(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h)
 {
-	if (p == NULL ) {
-		return;
+	if ( hl > hr + 1 ) {
+		return joinRight(left, hl, k, right, hr, h);
 	}
-	AVLNode<Key, Value>* pparent = p->getParent();
-	int8_t nextdiff;
-	if ( pparent != NULL ) { //if p is the root_ of the tree
-		if ( pparent->getLeft() == p ) { //if p is right child of pparent
-			nextdiff = 1;
-		}
-		else { //if p is left child of pparent
-			nextdiff = -1;
-		}
+	if ( hr > hl + 1 ) {
+		return joinLeft(left, hl, k, right, hr, h);
 	}
-	//based on the balances of the difference which is passed in and balance of parent
-	//determine whether or not to zig-zig or zig-zag and what the new balances should be
-	int8_t pbalance = p->getBalance();
-	int8_t tbalance = pbalance + difference;
-	if ( tbalance == -2 || tbalance == 2 ) { //two cases to rotate if total balance is -2 or 2
-		if ( tbalance == -2 ) { //if tbalance == -2
-			AVLNode<Key, Value>* pleft = p->getLeft();
-			int8_t pleftbal = pleft->getBalance();
-			if ( pleftbal == -1 ) { //if left child has another child
-				rotateright(p);
-				p->setBalance(0);
-				pleft->setBalance(0);
-				removefix(pparent , nextdiff);
-			}
-			else if ( pleftbal == 0 ) { //if no children
-				rotateright(p);
-				p->setBalance(-1);
-				pleft->setBalance(1);
-			}
-			else if ( pleftbal == 1 ) { //if left child has another child
-				AVLNode<Key, Value>* pleft_right = pleft->getRight();
-				rotateleft(pleft);
-				rotateright(p);
-				int8_t plrbal = pleft_right->getBalance();
-				if ( plrbal == 1 ) {
-					p->setBalance(0);
-					pleft->setBalance(-1);
-					pleft_right->setBalance(0);
-				}
-				else if ( plrbal == 0 ) {
-					p->setBalance(0);
-					pleft->setBalance(0);
-					pleft_right->setBalance(0);
-				}
-				else if ( plrbal == -1 ) {
-					p->setBalance(1);
-					pleft->setBalance(0);
-					pleft_right->setBalance(0);		
-				}
-				removefix(pparent, nextdiff); //call removefix again to update parents balance
-			}
-			
+	h = link(k, left, hl, right, hr);
+	return k;
+}
+
+// left is the taller tree: walk down its right spine to where right fits
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinRight(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h)
+{
+	AVLNode<Key, Value>* l = left->getLeft();
+	AVLNode<Key, Value>* c = left->getRight();
+	int hll = hl - 1 - (left->getBalance() > 0 ? 1 : 0);
+	int hc = hl - 1 - (left->getBalance() < 0 ? 1 : 0);
+	if ( hc <= hr + 1 ) {
+		if ( std::max(hc, hr) + 1 <= hll + 1 ) { //k over (c, right) fits under left
+			int hk = link(k, c, hc, right, hr);
+			h = link(left, l, hll, k, hk);
+			return left;
 		}
-		else { //if tbalance == 2, case if total balance is 2, do opposite as if total balance was -2
-			AVLNode<Key, Value>* pright = p->getRight();
-			int8_t prightbal = pright->getBalance();
-			if ( prightbal == 1 ) {
-				rotateleft(p);
-				p->setBalance(0);
-				pright->setBalance(0);
-				removefix(pparent , nextdiff);
-			}
-			else if ( prightbal == 0 ) {
-				rotateleft(p);
-				p->setBalance(1);
-				pright->setBalance(-1);
-			}
-			else if ( prightbal == -1 ) {
-				AVLNode<Key, Value>* pright_left = pright->getLeft();
-				rotateright(pright);
-				rotateleft(p);
-				int8_t prlbal = pright_left->getBalance();
-				if ( prlbal == -1 ) {
-					p->setBalance(0);
-					pright->setBalance(1);
-					pright_left->setBalance(0);
-				}
-				else if ( prlbal == 0 ) {
-					p->setBalance(0);
-					pright->setBalance(0);
-					pright_left->setBalance(0);
-				}
-				else if ( prlbal == 1) {
-					p->setBalance(-1);
-					pright->setBalance(0);
-					pright_left->setBalance(0);		
-				}
-				removefix(pparent, nextdiff);
-			}
-			
+		//double rotation: c comes up between left and k
+		AVLNode<Key, Value>* c1 = c->getLeft();
+		AVLNode<Key, Value>* c2 = c->getRight();
+		int hc1 = hc - 1 - (c->getBalance() > 0 ? 1 : 0);
+		int hc2 = hc - 1 - (c->getBalance() < 0 ? 1 : 0);
+		int h1 = link(left, l, hll, c1, hc1);
+		int h2 = link(k, c2, hc2, right, hr);
+		h = link(c, left, h1, k, h2);
+		return c;
+	}
+	int ht;
+	AVLNode<Key, Value>* t = joinRight(c, hc, k, right, hr, ht);
+	if ( ht <= hll + 1 ) {
+		h = link(left, l, hll, t, ht);
+		return left;
+	}
+	//single left rotation at left
+	AVLNode<Key, Value>* tl = t->getLeft();
+	AVLNode<Key, Value>* tr = t->getRight();
+	int htl = ht - 1 - (t->getBalance() > 0 ? 1 : 0);
+	int htr = ht - 1 - (t->getBalance() < 0 ? 1 : 0);
+	int h1 = link(left, l, hll, tl, htl);
+	h = link(t, left, h1, tr, htr);
+	return t;
+}
+
+// mirror image of joinRight: right is the taller tree
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinLeft(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* k, AVLNode<Key, Value>* right, int hr, int& h)
+{
+	AVLNode<Key, Value>* r = right->getRight();
+	AVLNode<Key, Value>* c = right->getLeft();
+	int hrr = hr - 1 - (right->getBalance() < 0 ? 1 : 0);
+	int hc = hr - 1 - (right->getBalance() > 0 ? 1 : 0);
+	if ( hc <= hl + 1 ) {
+		if ( std::max(hc, hl) + 1 <= hrr + 1 ) {
+			int hk = link(k, left, hl, c, hc);
+			h = link(right, k, hk, r, hrr);
+			return right;
 		}
+		AVLNode<Key, Value>* c1 = c->getLeft();
+		AVLNode<Key, Value>* c2 = c->getRight();
+		int hc1 = hc - 1 - (c->getBalance() > 0 ? 1 : 0);
+		int hc2 = hc - 1 - (c->getBalance() < 0 ? 1 : 0);
+		int h1 = link(k, left, hl, c1, hc1);
+		int h2 = link(right, c2, hc2, r, hrr);
+		h = link(c, k, h1, right, h2);
+		return c;
+	}
+	int ht;
+	AVLNode<Key, Value>* t = joinLeft(left, hl, k, c, hc, ht);
+	if ( ht <= hrr + 1 ) {
+		h = link(right, t, ht, r, hrr);
+		return right;
+	}
+	AVLNode<Key, Value>* tl = t->getLeft();
+	AVLNode<Key, Value>* tr = t->getRight();
+	int htl = ht - 1 - (t->getBalance() > 0 ? 1 : 0);
+	int htr = ht - 1 - (t->getBalance() < 0 ? 1 : 0);
+	int h2 = link(right, tr, htr, r, hrr);
+	h = link(t, tl, htl, right, h2);
+	return t;
+}
+
+// Detaches the smallest node of t into min and returns what is left of t.
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::extractMin(AVLNode<Key, Value>* t, int ht, int& h, AVLNode<Key, Value>*& min)
+{
+	AVLNode<Key, Value>* l = t->getLeft();
+	AVLNode<Key, Value>* r = t->getRight();
+	int hr = ht - 1 - (t->getBalance() < 0 ? 1 : 0);
+	if ( l == NULL ) {
+		min = t;
+		t->setRight(NULL);
+		h = hr;
+		return r;
 	}
-	else if ( tbalance == -1 || tbalance == 1) {
-		if ( tbalance == -1 ) {
-			p->setBalance(-1);
-			return;
+	int hl = ht - 1 - (t->getBalance() > 0 ? 1 : 0);
+	int hrest;
+	AVLNode<Key, Value>* rest = extractMin(l, hl, hrest, min);
+	return joinNodes(rest, hrest, t, r, hr, h);
+}
+
+// Joins left < right without a connecting node by borrowing right's minimum.
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinTrees(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* right, int hr, int& h)
+{
+	if ( right == NULL ) {
+		h = hl;
+		return left;
+	}
+	if ( left == NULL ) {
+		h = hr;
+		return right;
+	}
+	AVLNode<Key, Value>* min;
+	int hrest;
+	AVLNode<Key, Value>* rest = extractMin(right, hr, hrest, min);
+	return joinNodes(left, hl, min, rest, hrest, h);
+}
+
+// Splits t into keys < key (left) and keys >= key (right).
+template<class Key, class Value>
+void AVLTree<Key, Value>::splitNodes(AVLNode<Key, Value>* t, int ht, const Key& key,
+                                     AVLNode<Key, Value>*& left, int& hl, AVLNode<Key, Value>*& right, int& hr)
+{
+	if ( t == NULL ) {
+		left = right = NULL;
+		hl = hr = 0;
+		return;
+	}
+	AVLNode<Key, Value>* l = t->getLeft();
+	AVLNode<Key, Value>* r = t->getRight();
+	int htl = ht - 1 - (t->getBalance() > 0 ? 1 : 0);
+	int htr = ht - 1 - (t->getBalance() < 0 ? 1 : 0);
+	if ( !(t->getKey() < key) ) { //t and its right subtree go right
+		AVLNode<Key, Value>* middle;
+		int hm;
+		splitNodes(l, htl, key, left, hl, middle, hm);
+		right = joinNodes(middle, hm, t, r, htr, hr);
+	}
+	else {
+		AVLNode<Key, Value>* middle;
+		int hm;
+		splitNodes(r, htr, key, middle, hm, right, hr);
+		left = joinNodes(l, htl, t, middle, hm, hl);
+	}
+}
+
+/*
+ * Removes every key in [lo, hi) by splitting the tree twice, deleting the
+ * middle piece and joining the outer two: O(log n + k) for k removed keys,
+ * with no per-key removefix. Returns k.
+ */
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::eraseRange(const Key& lo, const Key& hi)
+{
+	if ( this->root_ == NULL || !(lo < hi) ) {
+		return 0;
+	}
+	AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+	AVLNode<Key, Value> *left, *rest, *middle, *right;
+	int hleft, hrest, hmiddle, hright;
+	splitNodes(root, heightOf(root), lo, left, hleft, rest, hrest);
+	splitNodes(rest, hrest, hi, middle, hmiddle, right, hright);
+	size_t erased = this->subtreeSize(middle);
+	size_t dead = this->subtreeTombstones(middle);
+	this->noderemover(middle);
+	int h;
+	this->root_ = joinTrees(left, hleft, right, hright, h);
+	if ( this->root_ != NULL ) {
+		this->root_->setParent(NULL);
+	}
+	this->size_ -= erased;
+	this->tombstones_ -= dead;
+	this->resetExtremes();
+	return erased - dead;
+}
+
+/*
+ * Removes every item for which pred(item) is true and returns how many. When
+ * removing them one at a time would cost more than relinking the survivors
+ * (count * height > size), the survivors are rebuilt into a balanced tree in
+ * O(n) instead.
+ */
+template<class Key, class Value>
+template<typename Predicate>
+size_t AVLTree<Key, Value>::eraseIf(Predicate pred)
+{
+	std::vector<Node<Key, Value>*> keep;
+	std::vector<Node<Key, Value>*> erase;
+	std::vector<Node<Key, Value>*> dead;
+	for ( Node<Key, Value>* n = this->min_; n != NULL; n = this->successor(n) ) {
+		if ( n->isDeleted() ) { //never shown to pred, purged if we rebuild
+			dead.push_back(n);
+		}
+		else if ( pred(n->getItem()) ) {
+			erase.push_back(n);
 		}
 		else {
-			p->setBalance(1);
-			return;
+			keep.push_back(n);
+		}
+	}
+	if ( erase.empty() ) {
+		return 0;
+	}
+	size_t height = (size_t)heightOf(static_cast<AVLNode<Key, Value>*>(this->root_));
+	if ( erase.size() * height <= this->size_ ) { //few enough to remove one by one
+		for ( size_t i = 0; i < erase.size(); ++i ) {
+			removeNode(erase[i]);
 		}
+		return erase.size();
 	}
-	else if ( tbalance == 0 ) {
-		
-		removefix( pparent , nextdiff ); //recursive call up the tree
-		p->updateBalance(difference);
-		
+	for ( size_t i = 0; i < erase.size(); ++i ) {
+		delete erase[i];
 	}
-	
+	for ( size_t i = 0; i < dead.size(); ++i ) {
+		delete dead[i];
+	}
+	this->tombstones_ = 0;
+	rebuildFrom(keep);
+	return erase.size();
 }
 
 /*
- * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the predecessor and then remove.
+ * Moves every key >= key into right, replacing its contents. The surgery is
+ * O(log n); counting the moved nodes for size() is O(moved).
  */
 template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+void AVLTree<Key, Value>::split(const Key& key, AVLTree<Key, Value>& right)
 {
-    // TODO
-			if ( this->root_ != NULL) {
-			AVLNode<Key, Value> *remover = (AVLNode<Key, Value>*)this->root_;
-			while ( true ) {
-			Key check = remover->getKey();
-			if ( check == key ) { //if we found the key
-				if ( remover->getLeft() == NULL && remover->getRight() == NULL ) { //if node has no childre
-					if ( remover == this->root_ ) {
-						remover->setBalance(0);
-						this->root_ = NULL;
-						delete this->root_;
-						break;
-					}
-					AVLNode<Key, Value> *parent = remover->getParent();
-					if ( parent->getRight() == remover ) { //if remover is right child
-						parent->setRight(NULL);
-						removefix(parent , -1); //call removefix function to rotate and update balances
-					}
-					else if ( parent->getLeft() == remover ) { //if remover is left child
-						parent->setLeft(NULL);
-						removefix(parent , 1);//call removefix function to rotate and update balances
-					}
-					remover->setParent(NULL);
-					delete remover;
-					break;
-				}
-				else if ( remover->getLeft() == NULL || remover->getRight() == NULL ) { //if node has one child
-					if ( remover->getLeft() == NULL ) { //if the left node is NULL, right child exists
-						AVLNode<Key, Value> *rightchild = remover->getRight();
-						if ( remover->getParent() == NULL ) { //checking if the current node is the root_
-							remover->setBalance(0);
-							this->root_ = rightchild;
-							rightchild->setParent(NULL);
-							remover->setParent(NULL);	//remove locations of remover
-							remover->setRight(NULL);
-							break;
-						}
-						AVLNode<Key, Value> *parent = remover->getParent();
-						if ( remover == parent->getRight() ) { //if remover is the right child of its parent
-							parent->setRight(rightchild);
-							rightchild->setParent(parent);
-							removefix(parent , -1);//call removefix function to rotate and update balances
-							
-						}	
-						else{ //if remover is the leftchild of its parent
-							parent->setLeft(rightchild);
-							rightchild->setParent(parent);
-							removefix(parent , 1);//call removefix function to rotate and update balances
-						}		
-						remover->setParent(NULL);	//remove locations of remover
-						remover->setRight(NULL);
-					}
-					else if ( remover->getRight() == NULL ) { //if the right node is NULL, left child exists
-						AVLNode<Key, Value> *leftchild = remover->getLeft();
-						if ( remover->getParent() == NULL ) { //checking if the current node is the root_
-							remover->setBalance(0);
-							this->root_ = leftchild;
-							leftchild->setParent(NULL);
-							remover->setParent(NULL);	//remove locations of remover
-							remover->setLeft(NULL);
-							break;
-						}
-						AVLNode<Key, Value> *parent = remover->getParent();
-						if ( remover == parent->getRight() ) { //if remover is the right child of its parent
-							parent->setRight(leftchild);
-							leftchild->setParent(parent);		
-							removefix(parent , -1);//call removefix function to rotate and update balances
-						}	
-						else{ //if remover is the left child of its parent
-							parent->setLeft(leftchild);
-							leftchild->setParent(parent);
-							removefix(parent , 1);//call removefix function to rotate and update balances
-						}	
-						remover->setParent(NULL); //remove locations of remover
-						remover->setLeft(NULL);	
-					}
-					delete remover;
-					break;
-				}
-				else { //if node has both children
-					AVLNode<Key, Value> *pred = static_cast<AVLNode<Key, Value>*>(this->predecessor(remover));
-					
-					nodeSwap(remover, pred); //remover goes to pred, and pred goes to remover node position
-					//if you use pred, node you switch with only has left child or no child
+	right.clear();
+	AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+	AVLNode<Key, Value> *left, *moved;
+	int hleft, hmoved;
+	splitNodes(root, heightOf(root), key, left, hleft, moved, hmoved);
+	this->root_ = left;
+	right.root_ = moved;
+	if ( left != NULL ) {
+		left->setParent(NULL);
+	}
+	if ( moved != NULL ) {
+		moved->setParent(NULL);
+	}
+	right.size_ = this->subtreeSize(moved);
+	right.tombstones_ = this->subtreeTombstones(moved);
+	this->size_ -= right.size_;
+	this->tombstones_ -= right.tombstones_;
+	this->resetExtremes();
+	right.resetExtremes();
+}
 
-					remove(remover->getKey());
-				}
-			}
-			else if ( key < check ) { //if the current key  node is less than remover key
-				if ( remover->getLeft() == NULL ) {
-					break;
-				}
-				remover = remover->getLeft();
-			}
-			else if (key > check){ //if the current key  node is greater than remover key
-				if ( remover->getRight() == NULL ) {
-					break;
-				}
-				remover = remover->getRight();
-			}
-			else { //means no key in tree
-				break;
-			}
-		}	
+/*
+ * Moves all of right, whose keys must all be greater than this tree's, onto
+ * the end of this tree in O(log n) and leaves right empty. Throws
+ * std::invalid_argument if the key ranges overlap.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::join(AVLTree<Key, Value>& right)
+{
+	if ( &right == this || right.root_ == NULL ) {
+		return;
+	}
+	if ( this->max_ != NULL && !(this->max_->getKey() < right.min_->getKey()) ) {
+		throw std::invalid_argument("join needs every key of right above this tree's keys");
 	}
+	AVLNode<Key, Value>* left = static_cast<AVLNode<Key, Value>*>(this->root_);
+	AVLNode<Key, Value>* other = static_cast<AVLNode<Key, Value>*>(right.root_);
+	int h;
+	this->root_ = joinTrees(left, heightOf(left), other, heightOf(other), h);
+	this->root_->setParent(NULL);
+	this->size_ += right.size_;
+	this->tombstones_ += right.tombstones_;
+	if ( this->min_ == NULL ) {
+		this->min_ = right.min_;
+	}
+	this->max_ = right.max_;
+	right.root_ = NULL;
+	right.min_ = NULL;
+	right.max_ = NULL;
+	right.size_ = 0;
+	right.tombstones_ = 0;
 }
 
+/**
+* verify() hook: the stored balance must equal the real height difference,
+* which must be within one.
+*/
+template<class Key, class Value>
+const char* AVLTree<Key, Value>::verifyNode(Node<Key, Value>* n, int leftHeight, int rightHeight) const
+{
+	if ( rightHeight - leftHeight < -1 || rightHeight - leftHeight > 1 ) {
+		return "subtree heights differ by more than one";
+	}
+	if ( static_cast<AVLNode<Key, Value>*>(n)->getBalance() != rightHeight - leftHeight ) {
+		return "stored balance does not match subtree heights";
+	}
+	return NULL;
+}
 
+/**
+* verifySample() hook: what one node's balance must look like given its children,
+* without knowing the subtree heights.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+const char* AVLTree<Key, Value>::verifyNodeLocal(Node<Key, Value>* n) const
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int8_t tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+	AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(n);
+	int8_t balance = node->getBalance();
+	if ( balance < -1 || balance > 1 ) {
+		return "stored balance out of range";
+	}
+	AVLNode<Key, Value>* left = node->getLeft();
+	AVLNode<Key, Value>* right = node->getRight();
+	if ( left == NULL && right == NULL && balance != 0 ) {
+		return "leaf with nonzero balance";
+	}
+	if ( left == NULL && right != NULL && (balance != 1 || right->getLeft() != NULL || right->getRight() != NULL) ) {
+		return "node with only a right child is not right-heavy by one";
+	}
+	if ( right == NULL && left != NULL && (balance != -1 || left->getLeft() != NULL || left->getRight() != NULL) ) {
+		return "node with only a left child is not left-heavy by one";
+	}
+	return NULL;
+}
+
+template<class Key, class Value>
+int AVLTree<Key, Value>::resetbalances( AVLNode <Key,Value>* n )
+{
+	if ( n == NULL ) {
+		return 0;
+	}
+	int left = resetbalances(n->getLeft());
+	int right = resetbalances(n->getRight());
+	n->setBalance(right - left);
+	return 1 + std::max(left, right);
 }
 
 
+/*
+ * Allocates the node for a new item; derived trees return their own node type.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::newNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+	return new AVLNode<Key, Value>(key, value, parent);
+}
+
 #endif
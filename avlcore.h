@@ -0,0 +1,506 @@
+#ifndef AVLCORE_H
+#define AVLCORE_H
+
+#include <cstdint>
+#include <cstdlib>
+
+/**
+* What AVLAlgorithms reports back to the tree as it works, so the tree can count
+* rebalancing work or keep per-subtree data current. This default does nothing;
+* a tree that wants the calls passes its own struct with the same static members
+* as the Hooks argument.
+*/
+struct AVLNoHooks
+{
+    // n was just attached under its parent (or as the root), before the fix-up
+    template <typename Tree, typename NodeRef> static void linked(Tree&, NodeRef) { }
+    // a node was just spliced out from under parent, before the fix-up
+    template <typename Tree, typename NodeRef> static void unlinked(Tree&, NodeRef) { }
+    // lower was rotated down under upper: lower's children changed, then upper's
+    template <typename Tree, typename NodeRef> static void rotated(Tree&, NodeRef, NodeRef) { }
+    // n1 and n2 traded places, balances included
+    template <typename Tree, typename NodeRef> static void swapped(Tree&, NodeRef, NodeRef) { }
+    // insertfix or removefix did one single or double rotation
+    template <typename Tree> static void rebalanced(Tree&, bool) { }
+    // removefix moved up one level
+    template <typename Tree> static void removefixStep(Tree&) { }
+};
+
+/**
+* The rebalancing logic of the AVL trees (rotateleft/rotateright, insertfix,
+* removefix and nodeSwap), written once against an abstract node layout. AVLTree
+* runs on it through AVLNode pointers, and trees which do not store AVLNode
+* objects (compact nodes, index-linked nodes, nodes embedded in user objects)
+* share it the same way.
+*
+* The Tree argument must provide:
+*
+*   typedef ... NodeRef;                         // pointer, index, offset, ...
+*   NodeRef nil() const;
+*   NodeRef getRoot() const;                     void setRoot(NodeRef n);
+*   NodeRef getParent(NodeRef n) const;          void setParent(NodeRef n, NodeRef p);
+*   NodeRef getLeft(NodeRef n) const;            void setLeft(NodeRef n, NodeRef l);
+*   NodeRef getRight(NodeRef n) const;           void setRight(NodeRef n, NodeRef r);
+*   int8_t getBalance(NodeRef n) const;          void setBalance(NodeRef n, int8_t b);
+*
+* and, for the lookup helpers, const Key& getKey(NodeRef n) const.
+*
+* Balances are only ever set to -1, 0 or 1, so they may be packed into two bits.
+*/
+template <typename Tree, typename Hooks = AVLNoHooks>
+struct AVLAlgorithms
+{
+    typedef typename Tree::NodeRef NodeRef;
+
+    static void rotateleft(Tree& t, NodeRef n);
+    static void rotateright(Tree& t, NodeRef n);
+    static void insertfix(Tree& t, NodeRef p, NodeRef n);
+    static void removefix(Tree& t, NodeRef p, int8_t difference);
+    static void nodeSwap(Tree& t, NodeRef n1, NodeRef n2);
+
+    // Hooks a new, childless node under parent (nil for the root) and rebalances.
+    static void link(Tree& t, NodeRef parent, NodeRef n, bool left);
+    // Takes n out of the tree and rebalances. n is not freed.
+    static void unlink(Tree& t, NodeRef n);
+
+    static NodeRef minimum(const Tree& t, NodeRef n);
+    static NodeRef maximum(const Tree& t, NodeRef n);
+    static NodeRef successor(const Tree& t, NodeRef n);
+    static NodeRef predecessor(const Tree& t, NodeRef n);
+    template <typename Key>
+    static NodeRef find(const Tree& t, const Key& key);
+};
+
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::rotateright(Tree& t, NodeRef n)
+{
+	NodeRef nleft = t.getLeft(n);
+	NodeRef nparent = t.getParent(n);
+	if ( nparent != t.nil() ) { //need to check if nparent is nil, which means n is root
+		if ( t.getRight(nparent) == n ) { //if n is right child of nparent
+			t.setRight(nparent, nleft);
+		}
+		else { //if n is left child of nparent
+			t.setLeft(nparent, nleft);
+		}
+	}
+	else { //set nleft to the new root
+		t.setRoot(nleft);
+	}
+	t.setParent(nleft, nparent);
+	t.setParent(n, nleft);
+	NodeRef nleft_right = t.getRight(nleft);
+	if ( nleft_right != t.nil() ) { //if left child has a right child
+		t.setParent(nleft_right, n);
+	}
+	t.setLeft(n, nleft_right);
+	t.setRight(nleft, n);
+	Hooks::rotated(t, n, nleft);
+}
+
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::rotateleft(Tree& t, NodeRef n)
+{
+	NodeRef nright = t.getRight(n);
+	NodeRef nparent = t.getParent(n);
+	if ( nparent != t.nil() ) { //need to check if nparent is nil, meaning n is root
+		if ( t.getRight(nparent) == n ) { //if n is right child of nparent
+			t.setRight(nparent, nright);
+		}
+		else { //if n is left child of nparent
+			t.setLeft(nparent, nright);
+		}
+	}
+	else { //set nright to the new root
+		t.setRoot(nright);
+	}
+	t.setParent(nright, nparent);
+	t.setParent(n, nright);
+	NodeRef nright_left = t.getLeft(nright);
+	if ( nright_left != t.nil() ) { //if right child has a left child
+		t.setParent(nright_left, n);
+	}
+	t.setRight(n, nright_left);
+	t.setLeft(nright, n);
+	Hooks::rotated(t, n, nright);
+}
+
+/**
+* Walks up from the new node n under p, updating balances until a subtree keeps
+* its height, and rotates once where one side got two taller. The parent's new
+* balance is computed before it is stored so that +/-2 never has to be
+* representable.
+*/
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::insertfix(Tree& t, NodeRef p, NodeRef n)
+{
+	if ( p == t.nil() || t.getParent(p) == t.nil() ) {
+		return;
+	}
+	NodeRef pparent = t.getParent(p);
+	if ( t.getRight(pparent) == p ) { //if p is right child of pparent
+		int8_t pbalance = t.getBalance(pparent) + 1;
+		if ( pbalance == 0 ) { //if pparent balance is 0, the tree is balanced
+			t.setBalance(pparent, 0);
+			return;
+		}
+		else if ( pbalance == 1 ) { //if pparent balance is 1, recurse through to balance tree
+			t.setBalance(pparent, 1);
+			insertfix(t, pparent, p);
+		}
+		else { //if pparent balance is 2 , rotate nodes
+			if ( t.getRight(p) == n ) { //then zig-zig, means nodes are in straight direction
+				Hooks::rebalanced(t, false);
+				rotateleft(t, pparent);
+				t.setBalance(pparent, 0);
+				t.setBalance(p, 0);
+			}
+			else { //zig-zag
+				Hooks::rebalanced(t, true);
+				rotateright(t, p);
+				rotateleft(t, pparent);
+				int8_t nbalance = t.getBalance(n);
+				//checking child balance to see what the new rotated nodes balances will become
+				t.setBalance(p, nbalance == -1 ? 1 : 0);
+				t.setBalance(pparent, nbalance == 1 ? -1 : 0);
+				t.setBalance(n, 0);
+			}
+		}
+	}
+	else { //if p is left child of pparent
+		int8_t pbalance = t.getBalance(pparent) - 1;
+		if ( pbalance == 0 ) {
+			t.setBalance(pparent, 0);
+			return;
+		}
+		else if ( pbalance == -1 ) { //if pparent balance is -1, recurse through to balance tree
+			t.setBalance(pparent, -1);
+			insertfix(t, pparent, p);
+		}
+		else { //if pparent balance is -2 , rotate nodes
+			if ( t.getLeft(p) == n ) { //then zig-zig
+				Hooks::rebalanced(t, false);
+				rotateright(t, pparent);
+				t.setBalance(p, 0);
+				t.setBalance(pparent, 0);
+			}
+			else { //then zig-zag
+				Hooks::rebalanced(t, true);
+				rotateleft(t, p);
+				rotateright(t, pparent);
+				int8_t nbalance = t.getBalance(n);
+				t.setBalance(p, nbalance == 1 ? -1 : 0);
+				t.setBalance(pparent, nbalance == -1 ? 1 : 0);
+				t.setBalance(n, 0);
+			}
+		}
+	}
+}
+
+/**
+* p's subtree lost height on the side given by difference (+1 left, -1 right).
+* Rotates where p got two out of balance and keeps going up while the subtree
+* it heads is shorter than before.
+*/
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::removefix(Tree& t, NodeRef p, int8_t difference)
+{
+	if ( p == t.nil() ) {
+		return;
+	}
+	Hooks::removefixStep(t);
+	NodeRef pparent = t.getParent(p);
+	int8_t nextdiff = 0;
+	if ( pparent != t.nil() ) {
+		nextdiff = t.getLeft(pparent) == p ? 1 : -1;
+	}
+	int8_t tbalance = t.getBalance(p) + difference;
+	if ( tbalance == -2 ) {
+		NodeRef pleft = t.getLeft(p);
+		int8_t pleftbal = t.getBalance(pleft);
+		if ( pleftbal == -1 ) { //zig-zig, subtree gets shorter
+			Hooks::rebalanced(t, false);
+			rotateright(t, p);
+			t.setBalance(p, 0);
+			t.setBalance(pleft, 0);
+			removefix(t, pparent, nextdiff);
+		}
+		else if ( pleftbal == 0 ) { //zig-zig, subtree keeps its height
+			Hooks::rebalanced(t, false);
+			rotateright(t, p);
+			t.setBalance(p, -1);
+			t.setBalance(pleft, 1);
+		}
+		else { //zig-zag
+			NodeRef pleft_right = t.getRight(pleft);
+			int8_t plrbal = t.getBalance(pleft_right);
+			Hooks::rebalanced(t, true);
+			rotateleft(t, pleft);
+			rotateright(t, p);
+			t.setBalance(p, plrbal == -1 ? 1 : 0);
+			t.setBalance(pleft, plrbal == 1 ? -1 : 0);
+			t.setBalance(pleft_right, 0);
+			removefix(t, pparent, nextdiff);
+		}
+	}
+	else if ( tbalance == 2 ) { //mirror of the -2 case
+		NodeRef pright = t.getRight(p);
+		int8_t prightbal = t.getBalance(pright);
+		if ( prightbal == 1 ) {
+			Hooks::rebalanced(t, false);
+			rotateleft(t, p);
+			t.setBalance(p, 0);
+			t.setBalance(pright, 0);
+			removefix(t, pparent, nextdiff);
+		}
+		else if ( prightbal == 0 ) {
+			Hooks::rebalanced(t, false);
+			rotateleft(t, p);
+			t.setBalance(p, 1);
+			t.setBalance(pright, -1);
+		}
+		else {
+			NodeRef pright_left = t.getLeft(pright);
+			int8_t prlbal = t.getBalance(pright_left);
+			Hooks::rebalanced(t, true);
+			rotateright(t, pright);
+			rotateleft(t, p);
+			t.setBalance(p, prlbal == 1 ? -1 : 0);
+			t.setBalance(pright, prlbal == -1 ? 1 : 0);
+			t.setBalance(pright_left, 0);
+			removefix(t, pparent, nextdiff);
+		}
+	}
+	else if ( tbalance == -1 || tbalance == 1 ) { //height unchanged, stop here
+		t.setBalance(p, tbalance);
+	}
+	else { //p got shorter, keep going up the tree
+		t.setBalance(p, 0);
+		removefix(t, pparent, nextdiff);
+	}
+}
+
+/**
+* Same as BinarySearchTree::nodeSwap followed by swapping the balances, so each
+* position keeps its balance.
+*/
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::nodeSwap(Tree& t, NodeRef n1, NodeRef n2)
+{
+    if ( (n1 == n2) || (n1 == t.nil()) || (n2 == t.nil()) ) {
+        return;
+    }
+    NodeRef n1p = t.getParent(n1);
+    NodeRef n1r = t.getRight(n1);
+    NodeRef n1lt = t.getLeft(n1);
+    bool n1isLeft = n1p != t.nil() && n1 == t.getLeft(n1p);
+    NodeRef n2p = t.getParent(n2);
+    NodeRef n2r = t.getRight(n2);
+    NodeRef n2lt = t.getLeft(n2);
+    bool n2isLeft = n2p != t.nil() && n2 == t.getLeft(n2p);
+
+    t.setParent(n1, n2p);
+    t.setParent(n2, n1p);
+    t.setLeft(n1, n2lt);
+    t.setLeft(n2, n1lt);
+    t.setRight(n1, n2r);
+    t.setRight(n2, n1r);
+
+    if ( n1r != t.nil() && n1r == n2 ) {
+        t.setRight(n2, n1);
+        t.setParent(n1, n2);
+    }
+    else if ( n2r != t.nil() && n2r == n1 ) {
+        t.setRight(n1, n2);
+        t.setParent(n2, n1);
+    }
+    else if ( n1lt != t.nil() && n1lt == n2 ) {
+        t.setLeft(n2, n1);
+        t.setParent(n1, n2);
+    }
+    else if ( n2lt != t.nil() && n2lt == n1 ) {
+        t.setLeft(n1, n2);
+        t.setParent(n2, n1);
+    }
+
+    if ( n1p != t.nil() && n1p != n2 ) {
+        if ( n1isLeft ) t.setLeft(n1p, n2);
+        else t.setRight(n1p, n2);
+    }
+    if ( n1r != t.nil() && n1r != n2 ) {
+        t.setParent(n1r, n2);
+    }
+    if ( n1lt != t.nil() && n1lt != n2 ) {
+        t.setParent(n1lt, n2);
+    }
+
+    if ( n2p != t.nil() && n2p != n1 ) {
+        if ( n2isLeft ) t.setLeft(n2p, n1);
+        else t.setRight(n2p, n1);
+    }
+    if ( n2r != t.nil() && n2r != n1 ) {
+        t.setParent(n2r, n1);
+    }
+    if ( n2lt != t.nil() && n2lt != n1 ) {
+        t.setParent(n2lt, n1);
+    }
+
+    if ( t.getRoot() == n1 ) {
+        t.setRoot(n2);
+    }
+    else if ( t.getRoot() == n2 ) {
+        t.setRoot(n1);
+    }
+
+    int8_t tempB = t.getBalance(n1);
+    t.setBalance(n1, t.getBalance(n2));
+    t.setBalance(n2, tempB);
+    Hooks::swapped(t, n1, n2);
+}
+
+/**
+* Attaches n as parent's left or right child, then fixes the balances above it.
+*/
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::link(Tree& t, NodeRef parent, NodeRef n, bool left)
+{
+	t.setParent(n, parent);
+	t.setLeft(n, t.nil());
+	t.setRight(n, t.nil());
+	t.setBalance(n, 0);
+	if ( parent == t.nil() ) {
+		t.setRoot(n);
+		Hooks::linked(t, n);
+		return;
+	}
+	if ( left ) {
+		t.setLeft(parent, n);
+		Hooks::linked(t, n);
+		if ( t.getBalance(parent) == 1 ) { //if balance is 1, adding left node will set it to 0
+			t.setBalance(parent, 0);
+		}
+		else { //balance was 0, parent grew on the left
+			t.setBalance(parent, -1);
+			insertfix(t, parent, n);
+		}
+	}
+	else {
+		t.setRight(parent, n);
+		Hooks::linked(t, n);
+		if ( t.getBalance(parent) == -1 ) { //if the balance is -1, adding right node will set it to 0
+			t.setBalance(parent, 0);
+		}
+		else { //balance was 0, parent grew on the right
+			t.setBalance(parent, 1);
+			insertfix(t, parent, n);
+		}
+	}
+}
+
+/**
+* A node with two children is first swapped with its predecessor, so the node
+* to splice out has at most one child; then removefix runs from its parent.
+*/
+template <typename Tree, typename Hooks>
+void AVLAlgorithms<Tree, Hooks>::unlink(Tree& t, NodeRef n)
+{
+	if ( t.getLeft(n) != t.nil() && t.getRight(n) != t.nil() ) {
+		nodeSwap(t, n, predecessor(t, n));
+	}
+	NodeRef child = t.getLeft(n) != t.nil() ? t.getLeft(n) : t.getRight(n);
+	NodeRef parent = t.getParent(n);
+	if ( child != t.nil() ) {
+		t.setParent(child, parent);
+	}
+	if ( parent == t.nil() ) {
+		t.setRoot(child);
+	}
+	else if ( t.getLeft(parent) == n ) {
+		t.setLeft(parent, child);
+		Hooks::unlinked(t, parent);
+		removefix(t, parent, 1);
+	}
+	else {
+		t.setRight(parent, child);
+		Hooks::unlinked(t, parent);
+		removefix(t, parent, -1);
+	}
+	t.setParent(n, t.nil());
+	t.setLeft(n, t.nil());
+	t.setRight(n, t.nil());
+	t.setBalance(n, 0);
+}
+
+template <typename Tree, typename Hooks>
+typename AVLAlgorithms<Tree, Hooks>::NodeRef AVLAlgorithms<Tree, Hooks>::minimum(const Tree& t, NodeRef n)
+{
+	if ( n == t.nil() ) {
+		return n;
+	}
+	while ( t.getLeft(n) != t.nil() ) {
+		n = t.getLeft(n);
+	}
+	return n;
+}
+
+template <typename Tree, typename Hooks>
+typename AVLAlgorithms<Tree, Hooks>::NodeRef AVLAlgorithms<Tree, Hooks>::maximum(const Tree& t, NodeRef n)
+{
+	if ( n == t.nil() ) {
+		return n;
+	}
+	while ( t.getRight(n) != t.nil() ) {
+		n = t.getRight(n);
+	}
+	return n;
+}
+
+template <typename Tree, typename Hooks>
+typename AVLAlgorithms<Tree, Hooks>::NodeRef AVLAlgorithms<Tree, Hooks>::successor(const Tree& t, NodeRef n)
+{
+	if ( t.getRight(n) != t.nil() ) {
+		return minimum(t, t.getRight(n));
+	}
+	NodeRef parent = t.getParent(n);
+	while ( parent != t.nil() && t.getRight(parent) == n ) { //go up until we come from a left child
+		n = parent;
+		parent = t.getParent(n);
+	}
+	return parent;
+}
+
+template <typename Tree, typename Hooks>
+typename AVLAlgorithms<Tree, Hooks>::NodeRef AVLAlgorithms<Tree, Hooks>::predecessor(const Tree& t, NodeRef n)
+{
+	if ( t.getLeft(n) != t.nil() ) {
+		return maximum(t, t.getLeft(n));
+	}
+	NodeRef parent = t.getParent(n);
+	while ( parent != t.nil() && t.getLeft(parent) == n ) { //go up until we come from a right child
+		n = parent;
+		parent = t.getParent(n);
+	}
+	return parent;
+}
+
+template <typename Tree, typename Hooks>
+template <typename Key>
+typename AVLAlgorithms<Tree, Hooks>::NodeRef AVLAlgorithms<Tree, Hooks>::find(const Tree& t, const Key& key)
+{
+	NodeRef current = t.getRoot();
+	while ( current != t.nil() ) {
+		const Key& currentkey = t.getKey(current);
+		if ( key < currentkey ) {
+			current = t.getLeft(current);
+		}
+		else if ( currentkey < key ) {
+			current = t.getRight(current);
+		}
+		else {
+			return current;
+		}
+	}
+	return t.nil();
+}
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef AVLJOURNAL_H
+#define AVLJOURNAL_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "avlbst.h"
+#include "avlsnapshot.h"
+
+/*
+  Write-ahead journal for an AVLTree.
+
+  A JournaledAVLTree keeps three files next to each other:
+
+    <base>.snapshot      last full snapshot (see avlsnapshot.h)
+    <base>.journal       operations since that snapshot was started
+    <base>.journal.old   operations being folded into a new snapshot by a
+                         compaction that has not finished yet
+
+  Journal layout: a JournalFileHeader followed by fixed-size records
+
+    op (1 byte) | key | value | FNV-1a of the preceding bytes (4 bytes)
+
+  A record whose checksum does not match marks the torn tail of a crash; it and
+  anything after it are dropped on recovery.
+
+  Replaying a journal over a snapshot that already contains its effects gives the
+  same result, so recovery can always apply snapshot + journal.old + journal no
+  matter where a compaction was interrupted.
+*/
+
+static const char JOURNAL_MAGIC[8] = { 'A', 'V', 'L', 'J', 'R', 'N', 'L', '\0' };
+static const uint32_t JOURNAL_VERSION = 1;
+
+struct JournalFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t reserved;
+};
+
+enum JournalOp
+{
+    JOURNAL_INSERT = 1,
+    JOURNAL_REMOVE = 2
+};
+
+/**
+* An AVLTree whose insert/remove calls are recorded in an append-only journal.
+* Records are buffered and written with one fdatasync per group of
+* groupCommit operations (or on commit()); an operation is durable once the
+* commit covering it returns. compact() folds the journal into a fresh snapshot
+* on a background thread while new operations go to a new journal.
+*
+* Keys and values must be trivially copyable. Not thread-safe, like AVLTree.
+*/
+template <typename Key, typename Value>
+class JournaledAVLTree
+{
+public:
+    JournaledAVLTree(const std::string& basePath, size_t groupCommit = 64, uint64_t autoCompactBytes = 64 << 20);
+    ~JournaledAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void commit();
+
+    // Rebuilds the tree from the snapshot and journals; run by the constructor
+    void recover();
+    // Starts folding the journal into a new snapshot in the background
+    void compact();
+    // Waits for a running compaction and rethrows its error, if any
+    void waitForCompaction();
+
+    const AVLTree<Key, Value>& tree() const { return tree_; }
+
+protected:
+    struct LogEntry
+    {
+        Key key;
+        Value value;
+        uint8_t op;
+    };
+
+    static const size_t RECORD_BYTES = 1 + sizeof(Key) + sizeof(Value) + 4;
+
+    void append(uint8_t op, const Key& key, const Value& value);
+    void openJournal();
+    void closeJournal();
+    bool readJournal(const std::string& path, std::vector<LogEntry>& entries, off_t& validBytes) const;
+
+    AVLTree<Key, Value> tree_;
+    std::string snapshotPath_;
+    std::string journalPath_;
+    std::string oldJournalPath_;
+    size_t groupCommit_;
+    uint64_t autoCompactBytes_;
+
+    int fd_;
+    uint64_t journalBytes_;     // bytes in the current journal, including pending
+    std::vector<char> pending_; // records not written yet
+    size_t pendingOps_;
+
+    std::thread compactor_;
+    std::exception_ptr compactError_;
+
+private:
+    JournaledAVLTree(const JournaledAVLTree&);
+    JournaledAVLTree& operator=(const JournaledAVLTree&);
+};
+
+template <typename Key, typename Value>
+JournaledAVLTree<Key, Value>::JournaledAVLTree(const std::string& basePath, size_t groupCommit, uint64_t autoCompactBytes) :
+    snapshotPath_(basePath + ".snapshot"),
+    journalPath_(basePath + ".journal"),
+    oldJournalPath_(basePath + ".journal.old"),
+    groupCommit_(groupCommit ? groupCommit : 1),
+    autoCompactBytes_(autoCompactBytes),
+    fd_(-1),
+    journalBytes_(0),
+    pendingOps_(0)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "JournaledAVLTree requires trivially copyable keys and values");
+    recover();
+}
+
+template <typename Key, typename Value>
+JournaledAVLTree<Key, Value>::~JournaledAVLTree()
+{
+    try {
+        commit();
+    }
+    catch(...) {
+        // nothing sensible to do in a destructor, the operations were never acknowledged
+    }
+    if(compactor_.joinable()) {
+        compactor_.join();
+    }
+    closeJournal();
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    tree_.insert(keyValuePair);
+    append(JOURNAL_INSERT, keyValuePair.first, keyValuePair.second);
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::remove(const Key& key)
+{
+    tree_.remove(key);
+    Value unused;
+    memset(&unused, 0, sizeof(unused));
+    append(JOURNAL_REMOVE, key, unused);
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::append(uint8_t op, const Key& key, const Value& value)
+{
+    char record[RECORD_BYTES];
+    record[0] = (char)op;
+    memcpy(record + 1, &key, sizeof(Key));
+    memcpy(record + 1 + sizeof(Key), &value, sizeof(Value));
+    uint32_t checksum = (uint32_t)snapshotChecksum(record, RECORD_BYTES - 4);
+    memcpy(record + RECORD_BYTES - 4, &checksum, 4);
+    pending_.insert(pending_.end(), record, record + RECORD_BYTES);
+    journalBytes_ += RECORD_BYTES;
+
+    if(++pendingOps_ >= groupCommit_) {
+        commit();
+        if(autoCompactBytes_ > 0 && journalBytes_ >= autoCompactBytes_) {
+            compact();
+        }
+    }
+}
+
+/**
+* Writes every buffered record and waits for them to reach the disk.
+*/
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::commit()
+{
+    if(pending_.empty()) {
+        return;
+    }
+    SnapshotWriter::writeAll(fd_, pending_.data(), pending_.size());
+    if(::fdatasync(fd_) != 0) {
+        throw std::runtime_error("cannot sync journal " + journalPath_ + ": " + strerror(errno));
+    }
+    pending_.clear();
+    pendingOps_ = 0;
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::openJournal()
+{
+    fd_ = ::open(journalPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd_ < 0) {
+        throw std::runtime_error("cannot open journal " + journalPath_ + ": " + strerror(errno));
+    }
+    struct stat st;
+    if(::fstat(fd_, &st) != 0) {
+        throw std::runtime_error("cannot stat journal " + journalPath_ + ": " + strerror(errno));
+    }
+    journalBytes_ = (uint64_t)st.st_size;
+    if(st.st_size == 0) { //new journal, start with a header
+        JournalFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = JOURNAL_VERSION;
+        header.keySize = sizeof(Key);
+        header.valueSize = sizeof(Value);
+        SnapshotWriter::writeAll(fd_, reinterpret_cast<const char*>(&header), sizeof(header));
+        if(::fsync(fd_) != 0) {
+            throw std::runtime_error("cannot sync journal " + journalPath_ + ": " + strerror(errno));
+        }
+        // makes the new entry durable, and with it a rotation that just renamed
+        // the old journal away in the same directory
+        syncParentDirectory(journalPath_);
+        journalBytes_ = sizeof(header);
+    }
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::closeJournal()
+{
+    if(fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+/**
+* Appends the valid records of the journal at path to entries. Returns false if
+* the file does not exist; validBytes is set to the length of the valid prefix.
+*/
+template <typename Key, typename Value>
+bool JournaledAVLTree<Key, Value>::readJournal(const std::string& path, std::vector<LogEntry>& entries, off_t& validBytes) const
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        if(errno == ENOENT) return false;
+        throw std::runtime_error("cannot open journal " + path + ": " + strerror(errno));
+    }
+    std::vector<char> data;
+    char buffer[1 << 16];
+    ssize_t n;
+    while((n = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            ::close(fd);
+            throw std::runtime_error("cannot read journal " + path + ": " + strerror(errno));
+        }
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    ::close(fd);
+
+    validBytes = 0;
+    if(data.size() < sizeof(JournalFileHeader)) { //crashed while creating it
+        return true;
+    }
+    JournalFileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if(memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version != JOURNAL_VERSION ||
+       header.keySize != sizeof(Key) || header.valueSize != sizeof(Value)) {
+        throw std::runtime_error("journal " + path + " is not a journal for this key/value type");
+    }
+    size_t pos = sizeof(header);
+    while(pos + RECORD_BYTES <= data.size()) {
+        const char* record = data.data() + pos;
+        uint32_t checksum;
+        memcpy(&checksum, record + RECORD_BYTES - 4, 4);
+        if(checksum != (uint32_t)snapshotChecksum(record, RECORD_BYTES - 4) ||
+           (record[0] != JOURNAL_INSERT && record[0] != JOURNAL_REMOVE)) {
+            break; //torn tail
+        }
+        LogEntry entry;
+        entry.op = (uint8_t)record[0];
+        memcpy(&entry.key, record + 1, sizeof(Key));
+        memcpy(&entry.value, record + 1 + sizeof(Key), sizeof(Value));
+        entries.push_back(entry);
+        pos += RECORD_BYTES;
+    }
+    validBytes = (off_t)pos;
+    return true;
+}
+
+/**
+* Rebuilds the tree as snapshot + journal.old + journal. Instead of replaying
+* operations one by one, the log entries are sorted by key (keeping the last
+* one per key) and merged with the sorted snapshot, and the tree is built from
+* the result in O(n) with assignSorted. A torn tail is cut off the journal so
+* new records follow valid ones.
+*/
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::recover()
+{
+    waitForCompaction();
+    pending_.clear();
+    pendingOps_ = 0;
+    closeJournal();
+
+    std::vector<LogEntry> entries;
+    off_t validBytes = 0;
+    readJournal(oldJournalPath_, entries, validBytes);
+    if(readJournal(journalPath_, entries, validBytes) && ::truncate(journalPath_.c_str(), validBytes) != 0) {
+        throw std::runtime_error("cannot truncate journal " + journalPath_ + ": " + strerror(errno));
+    }
+
+    // last entry per key wins; stable sort keeps log order among equal keys
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const LogEntry& a, const LogEntry& b) { return a.key < b.key; });
+    size_t last = 0;
+    for(size_t i = 0; i < entries.size(); ++i) {
+        if(i + 1 < entries.size() && !(entries[i].key < entries[i + 1].key)) {
+            continue;
+        }
+        entries[last++] = entries[i];
+    }
+    entries.resize(last);
+
+    std::vector<std::pair<Key, Value> > merged;
+    struct stat st;
+    if(::stat(snapshotPath_.c_str(), &st) == 0) {
+        SnapshotView<Key, Value> snapshot(snapshotPath_);
+        merged.reserve(snapshot.size() + entries.size());
+        typename SnapshotView<Key, Value>::const_iterator it = snapshot.begin();
+        size_t e = 0;
+        while(it != snapshot.end() || e < entries.size()) {
+            if(e == entries.size() || (it != snapshot.end() && it->first < entries[e].key)) {
+                merged.push_back(std::make_pair(it->first, it->second));
+                ++it;
+                continue;
+            }
+            if(it != snapshot.end() && !(entries[e].key < it->first)) { //log entry replaces the snapshot record
+                ++it;
+            }
+            if(entries[e].op == JOURNAL_INSERT) {
+                merged.push_back(std::make_pair(entries[e].key, entries[e].value));
+            }
+            ++e;
+        }
+    }
+    else {
+        for(size_t e = 0; e < entries.size(); ++e) {
+            if(entries[e].op == JOURNAL_INSERT) {
+                merged.push_back(std::make_pair(entries[e].key, entries[e].value));
+            }
+        }
+    }
+    tree_.assignSorted(merged.begin(), merged.end());
+    openJournal();
+}
+
+/**
+* Commits, moves the journal aside as journal.old and starts a new one, then
+* writes a snapshot of the current contents on a background thread and deletes
+* journal.old once the snapshot is in place. The directory is fsynced after the
+* rotation and after the snapshot rename, so journal.old is never unlinked
+* before the snapshot replacing it is durable. Only copying the contents
+* happens on the calling thread.
+*/
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::compact()
+{
+    commit();
+    waitForCompaction();
+
+    struct stat st;
+    if(::stat(oldJournalPath_.c_str(), &st) != 0) {
+        closeJournal();
+        if(::rename(journalPath_.c_str(), oldJournalPath_.c_str()) != 0) {
+            throw std::runtime_error("cannot rotate journal " + journalPath_ + ": " + strerror(errno));
+        }
+        openJournal();
+    }
+    // else an earlier compaction died before finishing. recover() already replayed
+    // journal.old, so the new snapshot covers it; the current journal is kept
+    // because replaying it over the new snapshot is harmless.
+
+    std::vector<std::pair<Key, Value> >* contents = new std::vector<std::pair<Key, Value> >();
+    contents->reserve(tree_.size());
+    if(!tree_.empty()) {
+        for(typename AVLTree<Key, Value>::iterator it = tree_.begin(); it != tree_.end(); ++it) {
+            contents->push_back(std::make_pair(it->first, it->second));
+        }
+    }
+
+    std::string snapshotPath = snapshotPath_;
+    std::string oldJournalPath = oldJournalPath_;
+    std::exception_ptr* error = &compactError_;
+    compactor_ = std::thread([contents, snapshotPath, oldJournalPath, error]() {
+        try {
+            saveSnapshotRange<Key, Value>(contents->begin(), contents->end(), contents->size(),
+                                          snapshotPath, PodSnapshotSerializer<Key, Value>());
+            ::unlink(oldJournalPath.c_str());
+        }
+        catch(...) {
+            *error = std::current_exception();
+        }
+        delete contents;
+    });
+}
+
+template <typename Key, typename Value>
+void JournaledAVLTree<Key, Value>::waitForCompaction()
+{
+    if(compactor_.joinable()) {
+        compactor_.join();
+    }
+    if(compactError_) {
+        std::exception_ptr error = compactError_;
+        compactError_ = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+}
+
+#endif
@@ -0,0 +1,404 @@
+#ifndef AVLSNAPSHOT_H
+#define AVLSNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "avlbst.h"
+
+/*
+  Binary snapshots of an AVLTree.
+
+  File layout (little endian, native sizes):
+
+    SnapshotHeader   64 bytes
+    payload          count records in increasing key order
+
+  With the default PodSnapshotSerializer every record is a fixed-size
+  SnapshotRecord<Key, Value>, so a SnapshotView can mmap the file and binary
+  search it in place. Other serializers write variable-length records that are
+  decoded on load.
+*/
+
+static const char SNAPSHOT_MAGIC[8] = { 'A', 'V', 'L', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t fixedRecords;  // 1 if the payload is an array of SnapshotRecords
+    uint64_t count;
+    uint32_t keySize;       // sizeof(Key)/sizeof(Value) for fixed records, else 0
+    uint32_t valueSize;
+    uint64_t payloadBytes;
+    uint64_t checksum;      // FNV-1a over the payload
+    char reserved[16];
+};
+
+/**
+* One fixed-size record. Named first/second so it can be fed to assignSorted.
+*/
+template <typename Key, typename Value>
+struct SnapshotRecord
+{
+    Key first;
+    Value second;
+};
+
+/**
+* The default serializer: raw copies of trivially copyable keys and values.
+*/
+template <typename Key, typename Value>
+struct PodSnapshotSerializer
+{
+    static const bool fixedSize = true;
+};
+
+/**
+* 64-bit FNV-1a, used to detect truncated or corrupted snapshot files.
+*/
+inline uint64_t snapshotChecksum(const void* data, size_t len, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+* Buffered writer used by saveSnapshot; checksums everything it writes.
+*/
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(int fd) : fd_(fd), checksum_(14695981039346656037ULL), written_(0) { buffer_.reserve(1 << 20); }
+
+    void append(const void* data, size_t len)
+    {
+        checksum_ = snapshotChecksum(data, len, checksum_);
+        written_ += len;
+        const char* bytes = static_cast<const char*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + len);
+        if(buffer_.size() >= (1 << 20)) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        writeAll(fd_, buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+    uint64_t checksum() const { return checksum_; }
+    uint64_t written() const { return written_; }
+
+    static void writeAll(int fd, const char* data, size_t len)
+    {
+        while(len > 0) {
+            ssize_t n = ::write(fd, data, len);
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                throw std::runtime_error(std::string("snapshot write failed: ") + strerror(errno));
+            }
+            data += n;
+            len -= (size_t)n;
+        }
+    }
+
+private:
+    int fd_;
+    uint64_t checksum_;
+    uint64_t written_;
+    std::vector<char> buffer_;
+};
+
+/**
+* fsyncs the directory holding path, so a file created, renamed or unlinked
+* there survives a crash. Without it POSIX lets those directory changes reach
+* the disk late or out of order.
+*/
+inline void syncParentDirectory(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) {
+        throw std::runtime_error("cannot open directory " + dir + ": " + strerror(errno));
+    }
+    int rc = ::fsync(fd);
+    int savedErrno = errno;
+    ::close(fd);
+    if(rc != 0) {
+        throw std::runtime_error("cannot sync directory " + dir + ": " + strerror(savedErrno));
+    }
+}
+
+template <typename Key, typename Value, typename InputIt, typename Serializer>
+void writeSnapshotRecords(InputIt first, InputIt last, SnapshotWriter& out, const Serializer&, std::true_type)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "PodSnapshotSerializer needs trivially copyable keys and values; pass a serializer");
+    SnapshotRecord<Key, Value> record;
+    memset(&record, 0, sizeof(record)); // keep padding bytes deterministic for the checksum
+    for( ; first != last; ++first) {
+        memcpy(&record.first, &first->first, sizeof(Key));
+        memcpy(&record.second, &first->second, sizeof(Value));
+        out.append(&record, sizeof(record));
+    }
+}
+
+template <typename Key, typename Value, typename InputIt, typename Serializer>
+void writeSnapshotRecords(InputIt first, InputIt last, SnapshotWriter& out, const Serializer& serializer, std::false_type)
+{
+    std::string record;
+    for( ; first != last; ++first) {
+        record.clear();
+        serializer.write(record, first->first, first->second);
+        out.append(record.data(), record.size());
+    }
+}
+
+/**
+* Writes the count items in [first, last), which must be in increasing key
+* order, as a snapshot at path. The file is written to path + ".tmp", fsynced
+* and renamed over path, so a crash never leaves a half-written snapshot. The
+* directory is fsynced after the rename, so the snapshot is durable on return.
+*
+* Serializer defaults to raw copies of trivially copyable keys/values. A custom
+* serializer sets fixedSize = false and provides
+*   void write(std::string& out, const Key& key, const Value& value) const;
+*   const char* read(const char* cur, const char* end, Key& key, Value& value) const;
+* where read returns the position after the record, or NULL if it is malformed.
+*/
+template <typename Key, typename Value, typename InputIt, typename Serializer>
+void saveSnapshotRange(InputIt first, InputIt last, uint64_t count, const std::string& path, const Serializer& serializer)
+{
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("cannot create snapshot " + tmpPath + ": " + strerror(errno));
+    }
+    try {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        // reserve space for the header, it is rewritten once the checksum is known
+        SnapshotWriter::writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+
+        SnapshotWriter out(fd);
+        std::integral_constant<bool, Serializer::fixedSize> fixed;
+        writeSnapshotRecords<Key, Value>(first, last, out, serializer, fixed);
+        out.flush();
+
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.fixedRecords = Serializer::fixedSize ? 1 : 0;
+        header.count = count;
+        header.keySize = Serializer::fixedSize ? sizeof(Key) : 0;
+        header.valueSize = Serializer::fixedSize ? sizeof(Value) : 0;
+        header.payloadBytes = out.written();
+        header.checksum = out.checksum();
+        if(::pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || ::fsync(fd) != 0) {
+            throw std::runtime_error("cannot finish snapshot " + tmpPath + ": " + strerror(errno));
+        }
+    }
+    catch(...) {
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+        throw;
+    }
+    ::close(fd);
+    if(::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot rename snapshot to " + path + ": " + strerror(errno));
+    }
+    syncParentDirectory(path);
+}
+
+/**
+* Writes tree to path in sorted order; see saveSnapshotRange.
+*/
+template <typename Key, typename Value, typename Serializer>
+void saveSnapshot(const AVLTree<Key, Value>& tree, const std::string& path, const Serializer& serializer)
+{
+    saveSnapshotRange<Key, Value>(tree.begin(), tree.end(), tree.size(), path, serializer);
+}
+
+template <typename Key, typename Value>
+void saveSnapshot(const AVLTree<Key, Value>& tree, const std::string& path)
+{
+    saveSnapshot(tree, path, PodSnapshotSerializer<Key, Value>());
+}
+
+/**
+* A read-only memory mapping of a snapshot file. Validates the header (and by
+* default the checksum) on open.
+*/
+class MappedSnapshotFile
+{
+public:
+    MappedSnapshotFile(const std::string& path, bool verify);
+    ~MappedSnapshotFile();
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(base_); }
+    const char* payload() const { return base_ + sizeof(SnapshotHeader); }
+    const char* payloadEnd() const { return payload() + header().payloadBytes; }
+
+private:
+    MappedSnapshotFile(const MappedSnapshotFile&);
+    MappedSnapshotFile& operator=(const MappedSnapshotFile&);
+
+    const char* base_;
+    size_t length_;
+};
+
+inline MappedSnapshotFile::MappedSnapshotFile(const std::string& path, bool verify) : base_(NULL), length_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("cannot open snapshot " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("snapshot " + path + " is truncated");
+    }
+    length_ = (size_t)st.st_size;
+    void* mapped = ::mmap(NULL, length_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) {
+        throw std::runtime_error("cannot map snapshot " + path + ": " + strerror(errno));
+    }
+    base_ = static_cast<const char*>(mapped);
+
+    const SnapshotHeader& h = header();
+    const char* error = NULL;
+    if(memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0) error = "is not a snapshot";
+    else if(h.version != SNAPSHOT_VERSION) error = "has an unsupported version";
+    else if(h.payloadBytes != length_ - sizeof(SnapshotHeader)) error = "is truncated";
+    else if(verify && snapshotChecksum(payload(), h.payloadBytes) != h.checksum) error = "fails its checksum";
+    if(error != NULL) {
+        ::munmap(const_cast<char*>(base_), length_);
+        throw std::runtime_error("snapshot " + path + " " + error);
+    }
+}
+
+inline MappedSnapshotFile::~MappedSnapshotFile()
+{
+    ::munmap(const_cast<char*>(base_), length_);
+}
+
+/**
+* Serves read-only lookups straight from a mapped snapshot with no parse step:
+* records are sorted, so find() is a binary search over the mapped pages and the
+* page cache does the loading. Only for snapshots written with fixed records.
+*/
+template <typename Key, typename Value>
+class SnapshotView
+{
+public:
+    typedef const SnapshotRecord<Key, Value>* const_iterator;
+
+    explicit SnapshotView(const std::string& path, bool verify = true);
+
+    size_t size() const { return end_ - begin_; }
+    const_iterator begin() const { return begin_; }
+    const_iterator end() const { return end_; }
+    // Returns the value for key, or NULL if it is not in the snapshot
+    const Value* find(const Key& key) const;
+
+private:
+    MappedSnapshotFile file_;
+    const_iterator begin_;
+    const_iterator end_;
+};
+
+template <typename Key, typename Value>
+SnapshotView<Key, Value>::SnapshotView(const std::string& path, bool verify) : file_(path, verify)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "SnapshotView maps records in place, so keys and values must be trivially copyable");
+    const SnapshotHeader& h = file_.header();
+    if(!h.fixedRecords || h.keySize != sizeof(Key) || h.valueSize != sizeof(Value) ||
+       h.payloadBytes != h.count * sizeof(SnapshotRecord<Key, Value>)) {
+        throw std::runtime_error("snapshot " + path + " does not hold fixed records of this key/value type");
+    }
+    begin_ = reinterpret_cast<const_iterator>(file_.payload());
+    end_ = begin_ + h.count;
+}
+
+template <typename Key, typename Value>
+const Value* SnapshotView<Key, Value>::find(const Key& key) const
+{
+    size_t lo = 0;
+    size_t hi = size();
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(begin_[mid].first < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo < size() && !(key < begin_[lo].first)) {
+        return &begin_[lo].second;
+    }
+    return NULL;
+}
+
+template <typename Key, typename Value, typename Serializer>
+void loadSnapshotRecords(AVLTree<Key, Value>& tree, const std::string& path, const Serializer&, std::true_type)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "PodSnapshotSerializer needs trivially copyable keys and values; pass a serializer");
+    SnapshotView<Key, Value> view(path);
+    tree.assignSorted(view.begin(), view.end());
+}
+
+template <typename Key, typename Value, typename Serializer>
+void loadSnapshotRecords(AVLTree<Key, Value>& tree, const std::string& path, const Serializer& serializer, std::false_type)
+{
+    MappedSnapshotFile file(path, true);
+    std::vector<std::pair<Key, Value> > items;
+    items.reserve(file.header().count);
+    const char* cur = file.payload();
+    const char* end = file.payloadEnd();
+    for(uint64_t i = 0; i < file.header().count; ++i) {
+        Key key;
+        Value value;
+        cur = cur ? serializer.read(cur, end, key, value) : NULL;
+        if(cur == NULL) {
+            throw std::runtime_error("snapshot " + path + " has a malformed record");
+        }
+        items.push_back(std::make_pair(key, value));
+    }
+    tree.assignSorted(items.begin(), items.end());
+}
+
+/**
+* Replaces the contents of tree with the snapshot at path, bulk-building the
+* tree in O(n) from the sorted records.
+*/
+template <typename Key, typename Value, typename Serializer>
+void loadSnapshot(AVLTree<Key, Value>& tree, const std::string& path, const Serializer& serializer)
+{
+    std::integral_constant<bool, Serializer::fixedSize> fixed;
+    loadSnapshotRecords(tree, path, serializer, fixed);
+}
+
+template <typename Key, typename Value>
+void loadSnapshot(AVLTree<Key, Value>& tree, const std::string& path)
+{
+    loadSnapshot(tree, path, PodSnapshotSerializer<Key, Value>());
+}
+
+#endif
@@ -0,0 +1,677 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <malloc.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "compactavl.h"
+#include "indexavl.h"
+#include "avlsnapshot.h"
+#include "latency.h"
+#include "shardedmap.h"
+#include "skiplist.h"
+#include "combining.h"
+#include "intrusiveavl.h"
+#include "aggregateavl.h"
+#include "intervaltree.h"
+#include "orderedcache.h"
+
+using namespace std;
+
+// Bytes currently handed out by malloc, so bytes/entry includes allocator overhead.
+static size_t heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static double nsPerOp(chrono::steady_clock::time_point start, size_t ops)
+{
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / (ops ? ops : 1);
+}
+
+// Per-run hot-path counters; only trees derived from BinarySearchTree have them
+template <typename Key, typename Value>
+void dumpStats(const BinarySearchTree<Key, Value>* tree)
+{
+#ifdef BST_STATS
+    TreeStats s = tree->stats();
+    cout << "                 comparisons " << s.keyComparisons
+         << "  rotations " << s.singleRotations << "+" << s.doubleRotations << " (single+double)"
+         << "  removefix steps " << s.removefixSteps
+         << "  find nodes/op " << setprecision(2) << (s.finds ? (double)s.findNodesVisited / s.finds : 0.0)
+         << " (max " << s.maxFindDepth << ")"
+         << "  iterator parent hops " << s.iteratorParentHops << endl;
+#endif
+}
+
+void dumpStats(const void*)
+{
+}
+
+template <typename Tree>
+void runBench(const string& name, size_t nodeBytes, const vector<int>& keys)
+{
+    size_t heapBefore = heapInUse();
+    Tree* tree = new Tree;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree->insert(std::make_pair(keys[i], (int)i));
+    }
+    double insertNs = nsPerOp(start, keys.size());
+    double bytesPerEntry = (double)(heapInUse() - heapBefore - sizeof(Tree)) / tree->size();
+
+    long checksum = 0;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        checksum += tree->find(keys[i])->second;
+    }
+    double findNs = nsPerOp(start, keys.size());
+
+    start = chrono::steady_clock::now();
+    for(typename Tree::iterator it = tree->begin(); it != tree->end(); ++it) {
+        checksum += it->first;
+    }
+    double scanNs = nsPerOp(start, keys.size());
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree->remove(keys[i]);
+    }
+    double removeNs = nsPerOp(start, keys.size());
+
+    cout << left << setw(16) << name << right << fixed << setprecision(1)
+         << " insert " << setw(7) << insertNs << " ns"
+         << "  find " << setw(7) << findNs << " ns"
+         << "  scan " << setw(5) << scanNs << " ns"
+         << "  remove " << setw(7) << removeNs << " ns"
+         << "  node " << setw(3) << nodeBytes << " B"
+         << "  bytes/entry " << setw(6) << bytesPerEntry
+         << "  (" << checksum % 10 << ")" << endl;
+    dumpStats(tree);
+    delete tree;
+}
+
+// Cold start: rebuilding by reinserting vs. loading a snapshot vs. mapping it
+void runSnapshotBench(const vector<int>& keys)
+{
+    const char* path = "bst-bench.snapshot";
+    AVLTree<int, int> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    double reinsertMs = nsPerOp(start, 1) / 1e6;
+
+    start = chrono::steady_clock::now();
+    saveSnapshot(tree, path);
+    double saveMs = nsPerOp(start, 1) / 1e6;
+
+    AVLTree<int, int> loaded;
+    start = chrono::steady_clock::now();
+    loadSnapshot(loaded, path);
+    double loadMs = nsPerOp(start, 1) / 1e6;
+
+    start = chrono::steady_clock::now();
+    SnapshotView<int, int> view(path, false);
+    double mapMs = nsPerOp(start, 1) / 1e6;
+    remove(path);
+
+    cout << fixed << setprecision(1)
+         << "snapshot         reinsert " << reinsertMs << " ms  save " << saveMs
+         << " ms  load " << loadMs << " ms  mmap open " << mapMs << " ms"
+         << "  (" << view.size() << " records)" << endl;
+}
+
+// Tail latency per operation, next to the rotation counts when built with BST_STATS
+void runLatencyBench(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    LatencyRecorder recorder;
+    TimedTree<AVLTree<int, int> > timed(tree, recorder);
+    long checksum = 0;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        timed.insert(std::make_pair(keys[i], (int)i));
+    }
+    for(size_t i = 0; i < keys.size(); ++i) {
+        checksum += timed.find(keys[i])->second;
+    }
+    for(size_t i = 0; i < keys.size(); ++i) {
+        timed.remove(keys[i]);
+    }
+    cout << "latency (AVLTree, " << checksum % 10 << ")" << endl;
+    recorder.report(cout);
+    dumpStats(&tree);
+}
+
+// Batches of 128 lookups: a find loop vs. findMany
+void runBatchBench(const vector<int>& keys)
+{
+    const size_t batch = 128;
+    AVLTree<int, int> tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    mt19937 rng(777);
+    vector<vector<int> > batches(keys.size() / batch);
+    for(size_t b = 0; b < batches.size(); ++b) {
+        for(size_t i = 0; i < batch; ++i) {
+            batches[b].push_back(keys[rng() % keys.size()]);
+        }
+    }
+    vector<AVLTree<int, int>::iterator> out(batch);
+    long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t b = 0; b < batches.size(); ++b) {
+        for(size_t i = 0; i < batch; ++i) {
+            out[i] = tree.find(batches[b][i]);
+        }
+        checksum += out[0]->second;
+    }
+    double loopNs = nsPerOp(start, batches.size() * batch);
+    start = chrono::steady_clock::now();
+    for(size_t b = 0; b < batches.size(); ++b) {
+        tree.findMany(batches[b], out);
+        checksum += out[0]->second;
+    }
+    double manyNs = nsPerOp(start, batches.size() * batch);
+    cout << fixed << setprecision(1)
+         << "batch of " << batch << "     find loop " << loopNs << " ns  findMany " << manyNs
+         << " ns  (" << checksum % 10 << ")" << endl;
+}
+
+// Expiring the oldest 10%, or every other key: key-by-key remove vs. eraseRange/eraseIf.
+// Each measurement gets a freshly built tree.
+double timeErase(const vector<int>& keys, int mode)
+{
+    int cutoff = (int)(keys.size() / 10);
+    AVLTree<int, int> tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if(mode == 0) {
+        for(int key = 0; key < cutoff; ++key) {
+            tree.remove(key);
+        }
+    }
+    else if(mode == 1) {
+        tree.eraseRange(0, cutoff);
+    }
+    else if(mode == 2) {
+        vector<int> matching; // without eraseIf: find the matches, then remove them one by one
+        for(AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if(it->first % 2 == 0) {
+                matching.push_back(it->first);
+            }
+        }
+        for(size_t i = 0; i < matching.size(); ++i) {
+            tree.remove(matching[i]);
+        }
+    }
+    else {
+        tree.eraseIf([](const std::pair<const int, int>& item) { return item.first % 2 == 0; });
+    }
+    return nsPerOp(start, 1) / 1e6;
+}
+
+void runEraseBench(const vector<int>& keys)
+{
+    cout << fixed << setprecision(1)
+         << "erase 10% range  remove loop " << timeErase(keys, 0) << " ms  eraseRange " << timeErase(keys, 1) << " ms" << endl;
+    cout << "erase half       remove loop " << timeErase(keys, 2) << " ms  eraseIf " << timeErase(keys, 3) << " ms" << endl;
+}
+
+// Delete burst: remove half the keys in random order, eagerly vs. as tombstones
+// followed by one compact()
+void runLazyDeleteBench(const vector<int>& keys)
+{
+    AVLTree<int, int> eager, lazy;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        eager.insert(std::make_pair(keys[i], (int)i));
+        lazy.insert(std::make_pair(keys[i], (int)i));
+    }
+    lazy.setLazyDelete(true, 1.0);
+    size_t half = keys.size() / 2;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < half; ++i) {
+        eager.remove(keys[i]);
+    }
+    double eagerNs = nsPerOp(start, half);
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < half; ++i) {
+        lazy.remove(keys[i]);
+    }
+    double lazyNs = nsPerOp(start, half);
+    start = chrono::steady_clock::now();
+    lazy.compact();
+    double compactMs = nsPerOp(start, 1) / 1e6;
+    cout << fixed << setprecision(1)
+         << "delete half      remove " << eagerNs << " ns  lazy remove " << lazyNs << " ns  + compact "
+         << compactMs << " ms  (" << (eager.size() == lazy.size()) << ")" << endl;
+}
+
+// Range sums over random 1% windows: iterating from lowerBound vs. aggregate(),
+// and what keeping the aggregates costs insert
+void runAggregateBench(const vector<int>& keys)
+{
+    AVLTree<int, long> plain;
+    AggregateAVLTree<int, long> summed;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        plain.insert(std::make_pair(keys[i], (long)i));
+    }
+    double plainInsertNs = nsPerOp(start, keys.size());
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        summed.insert(std::make_pair(keys[i], (long)i));
+    }
+    double summedInsertNs = nsPerOp(start, keys.size());
+    int width = std::max(1, (int)(keys.size() / 100));
+    const size_t queries = 1000;
+    long scanned = 0, aggregated = 0;
+    start = chrono::steady_clock::now();
+    for(size_t q = 0; q < queries; ++q) {
+        int lo = keys[q % keys.size()];
+        for(AVLTree<int, long>::iterator it = plain.lowerBound(lo); it != plain.end() && it->first < lo + width; ++it) {
+            scanned += it->second;
+        }
+    }
+    double scanNs = nsPerOp(start, queries);
+    start = chrono::steady_clock::now();
+    for(size_t q = 0; q < queries; ++q) {
+        int lo = keys[q % keys.size()];
+        aggregated += summed.aggregate(lo, lo + width);
+    }
+    double aggregateNs = nsPerOp(start, queries);
+    cout << fixed << setprecision(1)
+         << "range sum 1%     scan " << scanNs << " ns  aggregate " << aggregateNs << " ns  (" << (scanned == aggregated)
+         << ")  insert " << plainInsertNs << " ns vs " << summedInsertNs << " ns" << endl;
+}
+
+// Overlap queries over intervals of up to 100 units: scanning every interval
+// from begin() vs. IntervalTree::overlapping
+void runIntervalBench(const vector<int>& keys)
+{
+    IntervalTree<int, int> intervals;
+    mt19937 rng(777);
+    for(size_t i = 0; i < keys.size(); ++i) {
+        intervals.insert(keys[i], keys[i] + (int)(rng() % 100), (int)i);
+    }
+    const size_t queries = 100;
+    size_t scanned = 0, visited = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t q = 0; q < queries; ++q) {
+        int a = keys[q % keys.size()], b = a + 50;
+        for(IntervalTree<int, int>::iterator it = intervals.begin(); it != intervals.end(); ++it) {
+            if(it->first <= b && it->second.end >= a) {
+                ++scanned;
+            }
+        }
+    }
+    double scanNs = nsPerOp(start, queries);
+    start = chrono::steady_clock::now();
+    for(size_t q = 0; q < queries; ++q) {
+        int a = keys[q % keys.size()];
+        visited += intervals.overlapping(a, a + 50, [](const IntervalTree<int, int>::Item&) { });
+    }
+    double treeNs = nsPerOp(start, queries);
+    cout << fixed << setprecision(1)
+         << "overlap query    scan " << scanNs << " ns  overlapping " << treeNs << " ns  (" << (scanned == visited) << ")" << endl;
+}
+
+// Read-through cache holding a tenth of the keys, with 80% of reads going to
+// a hot tenth: get, and put on a miss
+double timeCache(const vector<int>& keys, EvictionPolicy policy, double& hitRate)
+{
+    OrderedCache<int, int> cache(std::max<size_t>(1, keys.size() / 10), policy);
+    mt19937 rng(4242);
+    size_t hot = std::max<size_t>(1, keys.size() / 10);
+    size_t ops = keys.size();
+    int value;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < ops; ++i) {
+        int key = keys[rng() % 10 < 8 ? rng() % hot : rng() % keys.size()];
+        if(!cache.get(key, value)) {
+            cache.put(key, key);
+        }
+    }
+    double ns = nsPerOp(start, ops);
+    CacheCounters counters = cache.counters();
+    hitRate = 100.0 * counters.hits / (counters.hits + counters.misses);
+    return ns;
+}
+
+void runCacheBench(const vector<int>& keys)
+{
+    static const char* names[] = { "LRU", "LFU", "smallest", "largest" };
+    EvictionPolicy policies[] = { EVICT_LRU, EVICT_LFU, EVICT_SMALLEST_KEY, EVICT_LARGEST_KEY };
+    cout << "cache 10%       ";
+    for(int i = 0; i < 4; ++i) {
+        double hitRate;
+        double ns = timeCache(keys, policies[i], hitRate);
+        cout << fixed << setprecision(1) << " " << names[i] << " " << ns << " ns " << hitRate << "% hits";
+    }
+    cout << endl;
+}
+
+struct PooledItem
+{
+    int key;
+    int value;
+    IntrusiveAVLHook<PooledItem> hook;
+};
+
+struct PooledItemKey
+{
+    int operator()(const PooledItem& item) const { return item.key; }
+};
+
+// Linking objects that already live in a pool vs. copying them into AVLTree
+// nodes: insert all, then remove all, in random order
+void runIntrusiveBench(const vector<int>& keys)
+{
+    vector<PooledItem> pool(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        pool[i].key = keys[i];
+        pool[i].value = (int)i;
+    }
+    AVLTree<int, int> copied;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        copied.insert(std::make_pair(pool[i].key, pool[i].value));
+    }
+    double copiedInsertNs = nsPerOp(start, pool.size());
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        copied.remove(pool[i].key);
+    }
+    double copiedRemoveNs = nsPerOp(start, pool.size());
+    IntrusiveAVLTree<PooledItem, &PooledItem::hook, PooledItemKey> linked;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        linked.insert(pool[i]);
+    }
+    double linkedInsertNs = nsPerOp(start, pool.size());
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        linked.remove(pool[i]);
+    }
+    double linkedRemoveNs = nsPerOp(start, pool.size());
+    cout << fixed << setprecision(1)
+         << "pooled objects   AVLTree insert " << copiedInsertNs << " ns remove " << copiedRemoveNs
+         << " ns  intrusive insert " << linkedInsertNs << " ns remove " << linkedRemoveNs << " ns" << endl;
+}
+
+// Counter updates: find, then operator[] or insert, vs. one upsert
+void runCounterBench(const vector<int>& keys)
+{
+    AVLTree<int, int> lookups, upserts;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        int key = keys[i] % 65536;
+        if(lookups.find(key) != lookups.end()) {
+            lookups[key] += 1;
+        }
+        else {
+            lookups.insert(std::make_pair(key, 1));
+        }
+    }
+    double lookupNs = nsPerOp(start, keys.size());
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        upserts.upsert(keys[i] % 65536, [](int& n) { ++n; });
+    }
+    double upsertNs = nsPerOp(start, keys.size());
+    cout << fixed << setprecision(1)
+         << "counters         find+[]/insert " << lookupNs << " ns  upsert " << upsertNs << " ns"
+         << "  (" << (lookups.size() == upserts.size()) << ")" << endl;
+}
+
+// Mixed workload (50% find, 25% insert, 25% remove) from 1 to 64 threads on a
+// ShardedOrderedMap with one shard (one tree behind one lock), with 64 range
+// shards, and starting from one shard that splitHottest() re-splits online.
+double timeSharded(const vector<int>& keys, size_t threads, size_t shards, bool autoSplit)
+{
+    vector<int> splitKeys;
+    for(size_t i = 1; i < shards; ++i) {
+        splitKeys.push_back((int)(keys.size() * i / shards));
+    }
+    ShardedOrderedMap<int, int> map(splitKeys);
+    for(size_t i = 0; i < keys.size(); i += 2) {
+        map.insert(std::make_pair(keys[i], (int)i));
+    }
+    size_t perThread = keys.size() / threads;
+    atomic<bool> done(false);
+    thread splitter;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if(autoSplit) {
+        splitter = thread([&]() {
+            while(!done.load()) {
+                map.splitHottest(64);
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        });
+    }
+    vector<thread> workers;
+    for(size_t t = 0; t < threads; ++t) {
+        workers.push_back(thread([&, t]() {
+            mt19937 rng((unsigned)t);
+            int value;
+            for(size_t i = 0; i < perThread; ++i) {
+                int key = keys[rng() % keys.size()];
+                unsigned op = rng() % 4;
+                if(op < 2) {
+                    map.find(key, value);
+                }
+                else if(op == 2) {
+                    map.insert(std::make_pair(key, (int)i));
+                }
+                else {
+                    map.remove(key);
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < threads; ++t) {
+        workers[t].join();
+    }
+    double seconds = nsPerOp(start, 1) / 1e9;
+    done.store(true);
+    if(splitter.joinable()) {
+        splitter.join();
+    }
+    return perThread * threads / seconds / 1e6;
+}
+
+void runShardBench(const vector<int>& keys)
+{
+    cout << "sharded map      threads  1 shard  64 shards  auto-split  (Mops/s, "
+         << thread::hardware_concurrency() << " hardware threads)" << endl;
+    for(size_t threads = 1; threads <= 64; threads *= 2) {
+        cout << fixed << setprecision(2) << "                 " << setw(7) << threads
+             << "  " << setw(7) << timeSharded(keys, threads, 1, false)
+             << "  " << setw(9) << timeSharded(keys, threads, 64, false)
+             << "  " << setw(10) << timeSharded(keys, threads, 1, true) << endl;
+    }
+}
+
+// Lookups for timeMixed, which has maps with different find()s
+template <typename Map>
+bool lookup(Map& map, int key)
+{
+    return map.contains(key);
+}
+
+bool lookup(ConcurrentSkipListMap<int, int>& map, int key)
+{
+    return map.find(key) != map.end();
+}
+
+// The same mixed workload on one AVLTree behind a std::mutex, the same tree
+// behind a flat-combining front end, and the lock-free ConcurrentSkipListMap
+template <typename Map>
+double timeMixed(const vector<int>& keys, size_t threads, Map& map)
+{
+    for(size_t i = 0; i < keys.size(); i += 2) {
+        map.insert(std::make_pair(keys[i], (int)i));
+    }
+    size_t perThread = keys.size() / threads;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for(size_t t = 0; t < threads; ++t) {
+        workers.push_back(thread([&, t]() {
+            mt19937 rng((unsigned)t);
+            for(size_t i = 0; i < perThread; ++i) {
+                int key = keys[rng() % keys.size()];
+                unsigned op = rng() % 4;
+                if(op < 2) {
+                    lookup(map, key);
+                }
+                else if(op == 2) {
+                    map.insert(std::make_pair(key, (int)i));
+                }
+                else {
+                    map.remove(key);
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < threads; ++t) {
+        workers[t].join();
+    }
+    return perThread * threads / (nsPerOp(start, 1) / 1e9) / 1e6;
+}
+
+class LockedAVLTree
+{
+public:
+    void insert(const std::pair<const int, int>& item)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.insert(item);
+    }
+    void remove(int key)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.remove(key);
+    }
+    bool contains(int key)
+    {
+        lock_guard<mutex> guard(lock_);
+        return tree_.find(key) != tree_.end();
+    }
+
+private:
+    mutex lock_;
+    AVLTree<int, int> tree_;
+};
+
+void runConcurrentBench(const vector<int>& keys)
+{
+    cout << "shared tree      threads  mutex AVLTree  combining  skip list  (Mops/s)" << endl;
+    for(size_t threads = 1; threads <= 64; threads *= 2) {
+        LockedAVLTree locked;
+        CombiningAVLTree<int, int> combining;
+        ConcurrentSkipListMap<int, int> skipList;
+        cout << fixed << setprecision(2) << "                 " << setw(7) << threads
+             << "  " << setw(13) << timeMixed(keys, threads, locked)
+             << "  " << setw(9) << timeMixed(keys, threads, combining)
+             << "  " << setw(9) << timeMixed(keys, threads, skipList) << endl;
+    }
+}
+
+// Double-ended priority queue use: take the minimum until the tree is empty
+void runPopBench(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    long checksum = 0;
+    for(size_t i = 0; i < keys.size() / 2; ++i) {
+        int key = tree.begin()->first;
+        checksum += key;
+        tree.remove(key);
+    }
+    double removeNs = nsPerOp(start, keys.size() / 2);
+    start = chrono::steady_clock::now();
+    while(!tree.empty()) {
+        checksum += tree.popMin().first;
+    }
+    double popNs = nsPerOp(start, keys.size() - keys.size() / 2);
+    cout << fixed << setprecision(1)
+         << "min queue        begin()+remove " << removeNs << " ns  popMin " << popNs << " ns"
+         << "  (" << checksum % 10 << ")" << endl;
+}
+
+// One analyzeShape() pass over a full-size tree
+void runShapeBench(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    TreeShape shape = tree.analyzeShape();
+    double shapeMs = nsPerOp(start, 1) / 1e6;
+    start = chrono::steady_clock::now();
+    bool valid = tree.verify();
+    double verifyMs = nsPerOp(start, 1) / 1e6;
+    start = chrono::steady_clock::now();
+    valid = tree.verifySample(1000) && valid;
+    double sampleMs = nsPerOp(start, 1) / 1e6;
+    cout << fixed << setprecision(2)
+         << "shape (AVLTree)  analyze " << shapeMs << " ms  height " << shape.height
+         << "  average depth " << shape.averageDepth << "  leaves " << shape.leaves
+         << "  bytes " << shape.bytes << endl;
+    cout << "verify (AVLTree) full " << verifyMs << " ms  1000 sampled paths " << sampleMs << " ms  (" << valid << ")" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    // distinct keys in random order
+    vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = (int)i;
+    }
+    mt19937 rng(12345);
+    shuffle(keys.begin(), keys.end(), rng);
+
+    cout << "n = " << n << endl;
+    runBench<AVLTree<int, int> >("AVLTree", sizeof(AVLNode<int, int>), keys);
+    runBench<CompactAVLTree<int, int> >("CompactAVLTree", sizeof(CompactAVLNode<int, int>), keys);
+    runBench<IndexedAVLTree<int, int> >("IndexedAVLTree", sizeof(IndexedAVLSlot<int, int>), keys);
+    runSnapshotBench(keys);
+    runLatencyBench(keys);
+    runBatchBench(keys);
+    runCounterBench(keys);
+    runEraseBench(keys);
+    runLazyDeleteBench(keys);
+    runAggregateBench(keys);
+    runIntervalBench(keys);
+    runCacheBench(keys);
+    runIntrusiveBench(keys);
+    runPopBench(keys);
+    runShardBench(keys);
+    runConcurrentBench(keys);
+    runShapeBench(keys);
+    return 0;
+}
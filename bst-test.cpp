@@ -1,7 +1,24 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
 #include "bst.h"
 #include "avlbst.h"
+#include "compactavl.h"
+#include "indexavl.h"
+#include "avlsnapshot.h"
+#include "mappedavl.h"
+#include "avljournal.h"
+#include "latency.h"
+#include "shardedmap.h"
+#include "skiplist.h"
+#include "combining.h"
+#include "intrusiveavl.h"
+#include "aggregateavl.h"
+#include "intervaltree.h"
+#include "orderedcache.h"
 
 using namespace std;
 
@@ -26,6 +43,40 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     bt.remove('b');
 
+    // Scapegoat mode tests
+    BinarySearchTree<int,int> sg;
+    BinarySearchTree<int,int> noSg;
+    sg.setScapegoat(true);
+    for(int i = 0; i < 1000; ++i) {
+        sg.insert(std::make_pair(i, i));
+        noSg.insert(std::make_pair(i, i));
+    }
+    // isBalanced() is the strict AVL test; scapegoat mode only bounds the height
+    cout << "\nScapegoat tree size: " << sg.size() << ", height: " << sg.analyzeShape().height
+         << ", balanced: " << sg.isBalanced() << ", verify: " << sg.verify() << endl;
+    cout << "Sorted inserts without scapegoat, height: " << noSg.analyzeShape().height
+         << ", balanced: " << noSg.isBalanced() << ", verify: " << noSg.verify() << endl;
+    for(int i = 0; i < 1000; i += 2) {
+        sg.remove(i);
+    }
+    cout << "Scapegoat tree size after removals: " << sg.size() << ", balanced: " << sg.isBalanced() << ", verify: " << sg.verify() << endl;
+    AVLTree<int,int> sgAvl;
+    try {
+        sgAvl.setScapegoat(true);
+    }
+    catch(const std::logic_error& e) {
+        cout << "AVLTree scapegoat mode: " << e.what() << endl;
+    }
+
+    // Rebalance tests
+    BinarySearchTree<int,int> rb;
+    for(int i = 0; i < 100; ++i) {
+        rb.insert(std::make_pair(i, i));
+    }
+    cout << "\nSorted inserts balanced: " << rb.isBalanced() << endl;
+    rb.rebalance();
+    cout << "After rebalance balanced: " << rb.isBalanced() << endl;
+
     // AVL Tree Tests
     AVLTree<char,int> at;
     at.insert(std::make_pair('a',1));
@@ -44,5 +95,323 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Min/max tests
+    AVLTree<int,int> queue;
+    cout << "\nEmpty tree begin() == end(): " << (queue.begin() == queue.end()) << endl;
+    for(int i = 10; i > 0; --i) {
+        queue.insert(std::make_pair(i, i * 10));
+    }
+    cout << "min " << queue.min()->first << ", max " << queue.max()->first;
+    std::pair<int,int> low = queue.popMin();
+    std::pair<int,int> high = queue.popMax();
+    cout << ", popped " << low.first << " and " << high.first << ", now min " << queue.begin()->first
+         << ", max " << queue.max()->first << ", size " << queue.size() << endl;
+
+    // Upsert tests
+    AVLTree<char,int> counts;
+    const char* word = "mississippi";
+    for(const char* c = word; *c != '\0'; ++c) {
+        counts.upsert(*c, [](int& n) { ++n; });
+    }
+    counts.getOrCreate('z');
+    counts.insert_or_assign('m', 7);
+    cout << "\nCounts: ";
+    for(AVLTree<char,int>::iterator it = counts.begin(); it != counts.end(); ++it) {
+        cout << it->first << "=" << it->second << " ";
+    }
+    cout << (counts.tryGet('q') == NULL ? "(no q)" : "(q?)") << endl;
+
+    // Range erase tests
+    AVLTree<int,int> expiring;
+    for(int i = 0; i < 50; ++i) {
+        expiring.insert(std::make_pair(i, i));
+    }
+    size_t expired = expiring.eraseRange(10, 20);
+    size_t odd = expiring.eraseIf([](const std::pair<const int,int>& item) { return item.first % 2 == 1; });
+    AVLTree<int,int> upper;
+    expiring.split(30, upper);
+    cout << "\nErased " << expired << " in range and " << odd << " odd, split sizes " << expiring.size()
+         << " and " << upper.size();
+    expiring.join(upper);
+    cout << ", joined " << expiring.size() << ", valid " << expiring.verify() << endl;
+
+    // Lazy delete tests
+    AVLTree<int,int> lazy;
+    lazy.setLazyDelete(true, 0.5);
+    for(int i = 0; i < 10; ++i) {
+        lazy.insert(std::make_pair(i, i));
+    }
+    lazy.remove(0);
+    lazy.remove(5);
+    lazy.remove(9);
+    cout << "\nLazy delete: size " << lazy.size() << ", tombstones " << lazy.tombstones()
+         << ", min " << lazy.min()->first << ", max " << lazy.max()->first << ", found 5: " << (lazy.find(5) != lazy.end());
+    lazy.insert(std::make_pair(5, 50));
+    lazy.compact();
+    cout << ", after compact size " << lazy.size() << ", tombstones " << lazy.tombstones()
+         << ", valid " << lazy.verify() << endl;
+
+    // Range aggregate tests
+    AggregateAVLTree<int,long> bytes;
+    for(int i = 1; i <= 100; ++i) {
+        bytes.insert(std::make_pair(i, (long)i));
+    }
+    bytes.remove(50);
+    bytes.insert_or_assign(1, 1000);
+    bytes.upsert(2, [](long& n) { n *= 10; });
+    cout << "\nAggregate sum [1, 101): " << bytes.aggregate(1, 101) << ", [40, 60): " << bytes.aggregate(40, 60)
+         << ", [200, 300): " << bytes.aggregate(200, 300) << ", total " << bytes.total()
+         << ", valid " << bytes.verify() << endl;
+
+    // Interval tree tests
+    IntervalTree<int,char> booked;
+    booked.insert(1, 5, 'a');
+    booked.insert(3, 4, 'b');
+    booked.insert(6, 20, 'c');
+    booked.insert(10, 12, 'd');
+    booked.insert(15, 15, 'e');
+    cout << "\nOverlapping [4, 10]:";
+    booked.overlapping(4, 10, [](const IntervalTree<int,char>::Item& i) { cout << " " << i.second.value; });
+    cout << ", stabbing 15:";
+    size_t stabbed = booked.stabbing(15, [](const IntervalTree<int,char>::Item& i) { cout << " " << i.second.value; });
+    booked.remove(6);
+    cout << " (" << stabbed << "), after removing c: " << booked.stabbing(15, [](const IntervalTree<int,char>::Item&) { })
+         << ", valid " << booked.verify() << endl;
+
+    // Ordered cache tests
+    OrderedCache<int,int> recent(3, EVICT_LRU);
+    int cached;
+    recent.put(1, 10);
+    recent.put(2, 20);
+    recent.put(3, 30);
+    recent.get(1, cached);
+    recent.put(4, 40);
+    OrderedCache<int,int> newest(2, EVICT_SMALLEST_KEY);
+    newest.put(5, 50);
+    newest.put(7, 70);
+    bool keptOld = newest.put(1, 10);
+    CacheCounters counted = recent.counters();
+    cout << "\nLRU cache keeps 1: " << recent.contains(1) << ", keeps 2: " << recent.contains(2)
+         << ", hits " << counted.hits << ", evictions " << counted.evictions
+         << "; smallest-key cache kept 1: " << keptOld << ", keys:";
+    newest.scan(0, 100, [](const int& key, const int&) { cout << " " << key; });
+    cout << endl;
+
+    // Batched lookup tests
+    std::vector<int> wanted;
+    wanted.push_back(3);
+    wanted.push_back(42);
+    wanted.push_back(7);
+    std::vector<AVLTree<int,int>::iterator> found;
+    queue.findMany(wanted, found);
+    cout << "\nfindMany: " << found[0]->second << " " << (found[1] == queue.end()) << " " << found[2]->second << endl;
+
+    // Shape analysis tests
+    AVLTree<int,int> shaped;
+    for(int i = 0; i < 100; ++i) {
+        shaped.insert(std::make_pair(i, i));
+    }
+    TreeShape shape = shaped.analyzeShape();
+    cout << "\nShape: " << shape.nodes << " nodes, " << shape.leaves << " leaves, height " << shape.height
+         << ", average depth " << shape.averageDepth << ", " << shape.bytes << " bytes" << endl;
+    cout << "Verify: " << shaped.verify() << ", sampled: " << shaped.verifySample(8) << endl;
+    cout << "Top 2 levels as JSON: ";
+    shaped.exportJson(cout, 2);
+    shaped.exportDot(cout, 1);
+
+    // Sharded map tests
+    std::vector<int> cuts;
+    cuts.push_back(100);
+    cuts.push_back(200);
+    ShardedOrderedMap<int,int> sharded(cuts);
+    std::vector<std::thread> writers;
+    for(int t = 0; t < 4; ++t) {
+        writers.push_back(std::thread([&sharded, t]() {
+            for(int i = t; i < 300; i += 4) {
+                sharded.insert(std::make_pair(i, i * 2));
+            }
+        }));
+    }
+    for(size_t t = 0; t < writers.size(); ++t) {
+        writers[t].join();
+    }
+    sharded.splitHottest(8);
+    sharded.mergeShards(0);
+    sharded.splitShard(0);
+    int scanned = 0, previous = -1;
+    bool ordered = true;
+    sharded.scan(50, 250, [&](const std::pair<const int,int>& item) {
+        ordered = ordered && item.first > previous;
+        previous = item.first;
+        ++scanned;
+    });
+    int doubled = 0;
+    cout << "\nShardedOrderedMap size " << sharded.size() << ", shards " << sharded.shardCount()
+         << ", scanned " << scanned << " in order " << ordered
+         << ", 123 -> " << (sharded.find(123, doubled) ? doubled : -1) << endl;
+
+    // Lock-free skip list tests
+    ConcurrentSkipListMap<int,int> skip;
+    std::vector<std::thread> skippers;
+    for(int t = 0; t < 4; ++t) {
+        skippers.push_back(std::thread([&skip, t]() {
+            for(int i = t; i < 1000; i += 4) {
+                skip.insert(std::make_pair(i, i));
+            }
+            for(int i = t; i < 1000; i += 8) {
+                skip.remove(i);
+            }
+        }));
+    }
+    for(size_t t = 0; t < skippers.size(); ++t) {
+        skippers[t].join();
+    }
+    skip.insert(std::make_pair(1, 100));
+    int skipped = 0, last = -1;
+    bool sorted = true;
+    for(ConcurrentSkipListMap<int,int>::iterator iter = skip.begin(); iter != skip.end(); ++iter) {
+        sorted = sorted && iter->first > last;
+        last = iter->first;
+        ++skipped;
+    }
+    cout << "\nConcurrentSkipListMap size " << skip.size() << ", iterated " << skipped << " in order " << sorted
+         << ", 1 -> " << skip.find(1)->second << ", found 8: " << (skip.find(8) != skip.end()) << endl;
+
+    // Flat-combining tests
+    CombiningAVLTree<int,int> combined;
+    std::vector<std::thread> combiners;
+    for(int t = 0; t < 4; ++t) {
+        combiners.push_back(std::thread([&combined, t]() {
+            for(int i = t; i < 400; i += 4) {
+                combined.insert(std::make_pair(i, -i));
+            }
+            for(int i = t; i < 400; i += 40) {
+                combined.remove(i);
+            }
+        }));
+    }
+    for(size_t t = 0; t < combiners.size(); ++t) {
+        combiners[t].join();
+    }
+    int negated = 0;
+    bool combinedValid = false;
+    combined.withTree([&combinedValid](AVLTree<int,int>& tree) { combinedValid = tree.verify(); });
+    cout << "\nCombiningAVLTree size " << combined.size() << ", 7 -> " << (combined.find(7, negated) ? negated : 0)
+         << ", contains 40: " << combined.contains(40) << ", valid " << combinedValid << endl;
+
+    // Intrusive AVL Tree tests
+    struct Task { int id; int priority; IntrusiveAVLHook<Task> byId, byPriority; };
+    struct TaskId { int operator()(const Task& t) const { return t.id; } };
+    struct TaskPriority { int operator()(const Task& t) const { return t.priority; } };
+    Task tasks[4] = { { 3, 20 }, { 1, 40 }, { 4, 10 }, { 2, 30 } };
+    IntrusiveAVLTree<Task, &Task::byId, TaskId> tasksById;
+    IntrusiveAVLTree<Task, &Task::byPriority, TaskPriority> tasksByPriority;
+    for(int i = 0; i < 4; ++i) {
+        tasksById.insert(tasks[i]);
+        tasksByPriority.insert(tasks[i]);
+    }
+    bool duplicate = tasksById.insert(tasks[0]).second;
+    tasksByPriority.remove(*tasksById.erase(1));
+    cout << "\nIntrusive by id:";
+    for(IntrusiveAVLTree<Task, &Task::byId, TaskId>::iterator t = tasksById.begin(); t != tasksById.end(); ++t) {
+        cout << " " << t->id;
+    }
+    cout << ", by priority:";
+    for(IntrusiveAVLTree<Task, &Task::byPriority, TaskPriority>::iterator t = tasksByPriority.begin(); t != tasksByPriority.end(); ++t) {
+        cout << " " << t->id;
+    }
+    cout << ", duplicate inserted: " << duplicate << ", priority >= 25: " << tasksByPriority.lowerBound(25)->id << endl;
+
+    // Compact AVL Tree tests
+    CompactAVLTree<char,int> ct;
+    ct.insert(std::make_pair('a',1));
+    ct.insert(std::make_pair('b',2));
+
+    cout << "\nCompactAVLTree contents:" << endl;
+    for(CompactAVLTree<char,int>::iterator it = ct.begin(); it != ct.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Erasing b" << endl;
+    ct.remove('b');
+    cout << "CompactAVLTree size: " << ct.size() << endl;
+
+    // Indexed AVL Tree tests
+    IndexedAVLTree<char,int> it;
+    it.insert(std::make_pair('a',1));
+    it.insert(std::make_pair('b',2));
+    IndexedAVLTree<char,int> itCopy(it.store());
+
+    cout << "\nIndexedAVLTree copy contents:" << endl;
+    for(IndexedAVLTree<char,int>::iterator iter = itCopy.begin(); iter != itCopy.end(); ++iter) {
+        cout << iter->first << " " << iter->second << endl;
+    }
+    cout << "Erasing b" << endl;
+    it.remove('b');
+    cout << "IndexedAVLTree size: " << it.size() << ", copy size: " << itCopy.size() << endl;
+
+    // Snapshot tests
+    AVLTree<int,int> snap;
+    for(int i = 0; i < 100; ++i) {
+        snap.insert(std::make_pair(i, i * i));
+    }
+    saveSnapshot(snap, "bst-test.snapshot");
+    AVLTree<int,int> loaded;
+    loadSnapshot(loaded, "bst-test.snapshot");
+    cout << "\nLoaded snapshot size: " << loaded.size() << ", balanced: " << loaded.isBalanced() << endl;
+    SnapshotView<int,int> view("bst-test.snapshot");
+    const int* nine = view.find(9);
+    cout << "Snapshot view lookup 9: " << (nine ? *nine : -1) << endl;
+    remove("bst-test.snapshot");
+
+    // Mapped AVL Tree tests
+    remove("bst-test.avlmap");
+    {
+        MappedAVLTree<int,int> mapped("bst-test.avlmap", 4);
+        for(int i = 0; i < 100; ++i) {
+            mapped.insert(std::make_pair(i, -i));
+        }
+        mapped.remove(50);
+        mapped.sync();
+    }
+    MappedAVLTree<int,int> reopened("bst-test.avlmap");
+    cout << "\nReopened MappedAVLTree size: " << reopened.size() << ", value at 7: " << reopened[7] << endl;
+    remove("bst-test.avlmap");
+
+    // Journal tests
+    remove("bst-test.snapshot");
+    remove("bst-test.journal");
+    {
+        JournaledAVLTree<int,int> journaled("bst-test", 8);
+        for(int i = 0; i < 20; ++i) {
+            journaled.insert(std::make_pair(i, i));
+        }
+        journaled.compact();
+        journaled.remove(3);
+        journaled.commit();
+    }
+    {
+        JournaledAVLTree<int,int> recovered("bst-test");
+        cout << "\nRecovered journaled tree size: " << recovered.tree().size() << endl;
+    }
+    remove("bst-test.snapshot");
+    remove("bst-test.journal");
+
+    // Latency recorder tests
+    AVLTree<int,int> latencyTree;
+    LatencyRecorder recorder, otherThread;
+    TimedTree<AVLTree<int,int> > timed(latencyTree, recorder);
+    for(int i = 0; i < 100; ++i) {
+        timed.insert(std::make_pair(i, i));
+    }
+    timed.find(50);
+    timed.remove(50);
+    for(uint64_t ns = 1; ns <= 1000; ++ns) {
+        otherThread.histogram(LATENCY_FIND).record(ns);
+    }
+    recorder.merge(otherThread);
+    const LatencyHistogram& finds = recorder.histogram(LATENCY_FIND);
+    cout << "\nLatency finds: " << finds.count() << ", inserts: " << recorder.histogram(LATENCY_INSERT).count()
+         << ", p50 within 6.25%: " << (finds.percentile(50) >= 500 && finds.percentile(50) <= 532) << endl;
+
     return 0;
 }
@@ -3,8 +3,92 @@
 
 #include <iostream>
 #include <exception>
+#include <cstdint>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
+
+/**
+ * One TreeStats counter. Lookups are const and may run concurrently (e.g. under
+ * ShardedOrderedMap's shared lock), so counting is a relaxed atomic add: no
+ * ordering, just no lost updates or data races. Copies read the current value.
+ */
+class StatCounter
+{
+public:
+    StatCounter(unsigned long long n = 0) : n_(n) { }
+    StatCounter(const StatCounter& other) : n_(other.get()) { }
+    StatCounter& operator=(const StatCounter& other) { n_.store(other.get(), std::memory_order_relaxed); return *this; }
+
+    StatCounter& operator++() { n_.fetch_add(1, std::memory_order_relaxed); return *this; }
+    // Raises the counter to n if it is lower (for maxima)
+    void raise(unsigned long long n)
+    {
+        unsigned long long current = get();
+        while(current < n && !n_.compare_exchange_weak(current, n, std::memory_order_relaxed)) { }
+    }
+    unsigned long long get() const { return n_.load(std::memory_order_relaxed); }
+    operator unsigned long long() const { return get(); }
+
+private:
+    std::atomic<unsigned long long> n_;
+};
+
+/**
+ * Counters for the trees' hot paths. They are only collected when compiling
+ * with -DBST_STATS (see DEFS in the Makefile); otherwise the counting statements
+ * compile to nothing and stats() returns all zeros.
+ */
+struct TreeStats
+{
+    TreeStats() : keyComparisons(0), singleRotations(0), doubleRotations(0), removefixSteps(0),
+                  finds(0), findNodesVisited(0), maxFindDepth(0), iteratorParentHops(0) { }
+
+    StatCounter keyComparisons;      // one per node visited while descending by key
+    StatCounter singleRotations;     // AVLTree insertfix/removefix
+    StatCounter doubleRotations;
+    StatCounter removefixSteps;      // levels removefix propagated through
+    StatCounter finds;               // internalFind calls
+    StatCounter findNodesVisited;    // nodes visited by internalFind
+    StatCounter maxFindDepth;        // most nodes visited by one internalFind
+    StatCounter iteratorParentHops;  // parent links followed by iterator ++
+};
+
+/**
+ * The shape of a tree as measured by BinarySearchTree::analyzeShape(). Depths
+ * count edges from the root, so the root is at depth 0.
+ */
+struct TreeShape
+{
+    TreeShape() : nodes(0), leaves(0), height(0), averageDepth(0.0), bytes(0) { }
+
+    size_t nodes;
+    size_t leaves;
+    size_t height;                          // nodes on the longest root-to-leaf path
+    double averageDepth;                    // mean path length from the root to a node
+    std::vector<size_t> depthHistogram;     // depthHistogram[d]: nodes at depth d
+    std::map<int, size_t> balanceFactors;   // height(right) - height(left) -> nodes with it
+    size_t bytes;                           // nodes * nodeFootprint() plus the tree object
+};
+
+#ifdef BST_STATS
+#define BST_STAT(expr) ((void)(expr))
+#else
+#define BST_STAT(expr) ((void)0)
+#endif
+
+// Hint that *p will be read soon (findMany); no-op where unsupported
+#if defined(__GNUC__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BST_PREFETCH(p) ((void)0)
+#endif
 
 /**
  * A templated class for a Node in a search tree.
@@ -34,10 +118,12 @@ public:
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    bool isDeleted() const;
+    void setDeleted(bool deleted);
 
 protected:
     std::pair<const Key, Value> item_;
-    Node<Key, Value>* parent_;
+    uintptr_t parentAndDeleted_;  // parent pointer | lazy-delete tombstone bit (still linked, but not in the map)
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
 };
@@ -54,11 +140,11 @@ protected:
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
     item_(key, value),
-    parent_(parent),
+    parentAndDeleted_(reinterpret_cast<uintptr_t>(parent)),
     left_(NULL),
     right_(NULL)
 {
-
+    static_assert(alignof(Node<Key, Value>) >= 2, "the tombstone bit needs 2-byte aligned nodes");
 }
 
 /**
@@ -123,7 +209,7 @@ Value& Node<Key, Value>::getValue()
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(parentAndDeleted_ & ~(uintptr_t)1);
 }
 
 /**
@@ -150,7 +236,7 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parentAndDeleted_ = reinterpret_cast<uintptr_t>(parent) | (parentAndDeleted_ & 1);
 }
 
 /**
@@ -180,6 +266,22 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* Whether the node is a lazy-delete tombstone (see BinarySearchTree::setLazyDelete).
+* The flag is the low bit of the parent link, so it costs no space.
+*/
+template<typename Key, typename Value>
+bool Node<Key, Value>::isDeleted() const
+{
+    return (parentAndDeleted_ & 1) != 0;
+}
+
+template<typename Key, typename Value>
+void Node<Key, Value>::setDeleted(bool deleted)
+{
+    parentAndDeleted_ = (parentAndDeleted_ & ~(uintptr_t)1) | (deleted ? 1 : 0);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -199,8 +301,21 @@ public:
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    bool verify(std::string* problem = NULL) const;
+    bool verifySample(size_t paths, std::string* problem = NULL) const;
+    virtual void rebalance();
     void print() const;
     bool empty() const;
+    size_t size() const;
+    virtual void setScapegoat(bool enabled, double alpha = 0.75);
+    void setLazyDelete(bool enabled, double maxTombstoneRatio = 0.25);
+    void compact();
+    size_t tombstones() const;
+    TreeStats stats() const;
+    void resetStats();
+    TreeShape analyzeShape() const;
+    void exportDot(std::ostream& out, int levels = -1) const;
+    void exportJson(std::ostream& out, int levels = -1) const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
@@ -225,21 +340,36 @@ public:
         friend class BinarySearchTree<Key, Value>;
         iterator(Node<Key,Value>* ptr);
         Node<Key, Value> *current_; 
+#ifdef BST_STATS
+        const BinarySearchTree<Key, Value>* owner_;
+#endif
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    iterator min() const;
+    iterator max() const;
+    std::pair<Key, Value> popMin();
+    std::pair<Key, Value> popMax();
     iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    void findMany(const std::vector<Key>& keys, std::vector<iterator>& out) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    std::pair<iterator, bool> insert_or_assign(const Key& key, const Value& value);
+    template <typename Fn>
+    Value& upsert(const Key& key, Fn fn);
+    Value& getOrCreate(const Key& key);
+    Value* tryGet(const Key& key);
+    const Value* tryGet(const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
-		static Node<Key, Value>* successor(Node<Key, Value>* current); // TODO
+		static Node<Key, Value>* successor(Node<Key, Value>* current, StatCounter* hops = NULL); // TODO
 
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -247,14 +377,50 @@ protected:
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    virtual void removeNode(Node<Key, Value>* n);
+    virtual Node<Key, Value>* insertOrFind(const Key& key, const Value& value, bool& inserted);
+    virtual void rebuildFrom(std::vector<Node<Key, Value>*>& nodes);
+    // Called after n's value or deleted mark was changed in place
+    virtual void itemChanged(Node<Key, Value>* /*n*/) { }
+    Node<Key, Value>* insertOrFindLive(const Key& key, const Value& value, bool& inserted);
+    void removeFound(Node<Key, Value>* n);
+    Node<Key, Value>* firstLive() const;
+    Node<Key, Value>* lastLive() const;
+    void noteInserted(Node<Key, Value>* added);
+    void noteRemoving(Node<Key, Value>* n);
+    void resetExtremes();
+    // Bytes one node occupies, for TreeShape::bytes (allocator overhead not included)
+    virtual size_t nodeFootprint() const { return sizeof(Node<Key, Value>); }
+    // Invariants a derived tree adds on top of ordering and links: verifyNode gets
+    // the real subtree heights, verifyNodeLocal only what the node and its children store
+    virtual const char* verifyNode(Node<Key, Value>* /*n*/, int /*leftHeight*/, int /*rightHeight*/) const { return NULL; }
+    virtual const char* verifyNodeLocal(Node<Key, Value>* /*n*/) const { return NULL; }
 
     // Add helper functions here
 		int calculateheight(Node<Key, Value> *root) const;
 		void noderemover(Node<Key, Value>* current);
+		size_t subtreeSize(Node<Key, Value>* current) const;
+		size_t subtreeTombstones(Node<Key, Value>* current) const;
+		void rebuildScapegoat(Node<Key, Value>* added);
+		void rebuildSubtree(Node<Key, Value>* top, size_t count);
+		static Node<Key, Value>* buildBalanced(std::vector<Node<Key, Value>*>& nodes, size_t lo, size_t hi, Node<Key, Value>* parent);
+		void rotateNodeLeft(Node<Key, Value>* n);
+		void rotateNodeRight(Node<Key, Value>* n);
+		void compressVine(size_t count);
+		static void measureSubtree(Node<Key, Value>* top, size_t& nodes, size_t& height);
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    Node<Key, Value>* min_;  // node with the smallest key, NULL when empty
+    Node<Key, Value>* max_;  // node with the largest key, NULL when empty
+    size_t size_;     // number of nodes currently in the tree
+    size_t maxSize_;  // scapegoat mode: largest size_ since the last full rebuild
+    double alpha_;    // scapegoat mode: weight-balance factor, 0 when the mode is off
+    size_t tombstones_;        // lazy-delete: nodes marked deleted but still linked (counted in size_)
+    double tombstoneRatio_;    // lazy-delete: compact past this fraction of tombstones, 0 when the mode is off
+#ifdef BST_STATS
+    mutable TreeStats stats_;
+#endif
 };
 
 /*
@@ -270,6 +436,9 @@ template<class Key, class Value>
 BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
 {
 		current_ = ptr;
+#ifdef BST_STATS
+		owner_ = NULL;
+#endif
 }
 
 /**
@@ -279,6 +448,9 @@ template<class Key, class Value>
 BinarySearchTree<Key, Value>::iterator::iterator() 
 {
 		current_ = nullptr;
+#ifdef BST_STATS
+		owner_ = NULL;
+#endif
 }
 
 /**
@@ -336,7 +508,13 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator&
 BinarySearchTree<Key, Value>::iterator::operator++()
 {
-		current_ = successor(current_); 
+		do { //skip lazy-delete tombstones
+#ifdef BST_STATS
+			current_ = successor(current_, owner_ != NULL ? &owner_->stats_.iteratorParentHops : NULL);
+#else
+			current_ = successor(current_); 
+#endif
+		} while ( current_ != NULL && current_->isDeleted() );
 		return *this;
 }
 /*
@@ -358,6 +536,13 @@ template<class Key, class Value>
 BinarySearchTree<Key, Value>::BinarySearchTree() 
 {
 		(this->root_) = NULL;
+		min_ = NULL;
+		max_ = NULL;
+		size_ = 0;
+		maxSize_ = 0;
+		alpha_ = 0;
+		tombstones_ = 0;
+		tombstoneRatio_ = 0;
 }
 
 template<typename Key, typename Value>
@@ -372,7 +557,66 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 template<class Key, class Value>
 bool BinarySearchTree<Key, Value>::empty() const
 {
-    return root_ == NULL;
+    return size() == 0;
+}
+
+/**
+ * Returns the number of items in the tree
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return size_ - tombstones_;
+}
+
+/**
+* Turns scapegoat mode on or off. While it is on, insert() watches the depth of
+* every new node and, once it exceeds log base 1/alpha of the size, rebuilds the
+* subtree of the first ancestor whose child holds more than alpha of its nodes.
+* remove() rebuilds the whole tree once the size drops below alpha times the
+* size at the last full rebuild. Nodes carry no extra balance data.
+* Turning the mode on rebuilds the current tree so it starts out balanced.
+* Self-balancing subclasses (AVLTree and its derivatives) refuse the mode.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setScapegoat(bool enabled, double alpha)
+{
+	if ( !enabled ) {
+		alpha_ = 0;
+		return;
+	}
+	if ( alpha <= 0.5 || alpha >= 1.0 ) {
+		throw std::invalid_argument("Scapegoat alpha must be in (0.5, 1)");
+	}
+	alpha_ = alpha;
+	if ( root_ != NULL ) {
+		rebuildSubtree(root_, size_);
+	}
+	maxSize_ = size_;
+}
+
+/**
+* Returns the hot-path counters collected since the last resetStats().
+* All zeros unless compiled with -DBST_STATS. Each counter is read on its own,
+* so a snapshot taken while other threads look things up is not consistent
+* across counters.
+*/
+template<typename Key, typename Value>
+TreeStats BinarySearchTree<Key, Value>::stats() const
+{
+#ifdef BST_STATS
+	return stats_;
+#else
+	return TreeStats();
+#endif
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetStats()
+{
+#ifdef BST_STATS
+	stats_ = TreeStats();
+#endif
 }
 
 template<typename Key, typename Value>
@@ -389,7 +633,10 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value>::iterator begin(firstLive());
+#ifdef BST_STATS
+    begin.owner_ = this;
+#endif
     return begin;
 }
 
@@ -414,9 +661,99 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
 {
     Node<Key, Value> *curr = internalFind(k);
     BinarySearchTree<Key, Value>::iterator it(curr);
+#ifdef BST_STATS
+    it.owner_ = this;
+#endif
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is not less than key, or end()
+* if there is none. O(height), plus the tombstones skipped in lazy-delete mode.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lowerBound(const Key& key) const
+{
+	Node<Key, Value>* bound = NULL;
+	Node<Key, Value>* n = root_;
+	while ( n != NULL ) {
+		BST_STAT(++stats_.keyComparisons);
+		if ( n->getKey() < key ) {
+			n = n->getRight();
+		}
+		else { //candidate; anything smaller is on the left
+			bound = n;
+			n = n->getLeft();
+		}
+	}
+	BinarySearchTree<Key, Value>::iterator it(bound);
+#ifdef BST_STATS
+	it.owner_ = this;
+#endif
+	if ( bound != NULL && bound->isDeleted() ) {
+		++it;
+	}
+	return it;
+}
+
+/**
+* Looks up every key in keys; out[i] becomes find(keys[i]). Up to 16 descents
+* are advanced in lockstep, one level per round, and the child each one moves to
+* is prefetched, so the cache misses of independent lookups overlap instead of
+* being paid one after another.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::findMany(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+	static const size_t GROUP = 16; //descents in flight
+	out.assign(keys.size(), end());
+	if ( root_ == NULL ) {
+		return;
+	}
+	Node<Key, Value>* cursor[GROUP];
+	size_t slot[GROUP]; //index into keys of each descent
+	size_t active = 0;
+	size_t next = 0;
+	while ( next < keys.size() || active > 0 ) {
+		while ( active < GROUP && next < keys.size() ) { //refill finished slots
+			cursor[active] = root_;
+			slot[active] = next++;
+			++active;
+		}
+		for ( size_t i = 0; i < active; ) {
+			Node<Key, Value>* n = cursor[i];
+			const Key& key = keys[slot[i]];
+			BST_STAT(++stats_.keyComparisons);
+			if ( key < n->getKey() ) {
+				n = n->getLeft();
+			}
+			else if ( n->getKey() < key ) {
+				n = n->getRight();
+			}
+			else { //found, unless it is a tombstone
+				if ( !n->isDeleted() ) {
+					iterator it(n);
+#ifdef BST_STATS
+					it.owner_ = this;
+#endif
+					out[slot[i]] = it;
+				}
+				n = NULL;
+			}
+			if ( n == NULL ) { //done, move the last descent into this slot
+				--active;
+				cursor[i] = cursor[active];
+				slot[i] = slot[active];
+				continue;
+			}
+			BST_PREFETCH(n);
+			cursor[i] = n;
+			++i;
+		}
+	}
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -445,39 +782,139 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 template<class Key, class Value>
 void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-	Key currentkey = keyValuePair.first; //find out how to access value
-	Value replace = keyValuePair.second;
-	if (!empty()) {
+	bool inserted;
+	Node<Key, Value>* node = insertOrFindLive(keyValuePair.first, keyValuePair.second, inserted);
+	if ( !inserted ) {
+		node->setValue(keyValuePair.second);
+		itemChanged(node);
+	}
+}
+
+/**
+* One descent that either finds the node holding key (inserted = false, value
+* unused) or adds a node with key and value (inserted = true). Every insert
+* and upsert-style method goes through here.
+*/
+template<class Key, class Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::insertOrFind(const Key& currentkey, const Value& replace, bool& inserted)
+{
+	Node<Key, Value>* added = NULL;
+	int depth = 0; //depth of bstiter, used by scapegoat mode
+	inserted = false;
+	if (root_ != NULL) {
 		Node<Key, Value>* bstiter = root_;
 		while ( true ) {
-			Key checkerkey = bstiter->getKey();
-			if ( currentkey == checkerkey ) { //if the key of the keyvaluepair is equal to current key of location, replace the values
-				bstiter->setValue(replace);
-				break;
+			BST_STAT(++stats_.keyComparisons);
+			const Key& checkerkey = bstiter->getKey();
+			if ( currentkey == checkerkey ) { //key already in the tree
+				return bstiter;
 			}
 			else if ( currentkey < checkerkey ) { //if key of keyvaluepair is less than current key of location, move left
 				if ( bstiter->getLeft() == NULL ) { //if the left is NULL, add to the tree
 					Node<Key, Value>* addnode  = new Node<Key, Value>(currentkey , replace , bstiter);
 					bstiter->setLeft(addnode);
+					added = addnode;
+					++depth;
 					break;
 				}
 				bstiter = bstiter->getLeft();
+				++depth;
 				
 			}
 			else if ( currentkey > checkerkey) { //if key of keyvaluepair is greater than current key of location, go right
 				if ( bstiter->getRight() == NULL ) { //if the right is NULL, add to tree
 					Node<Key, Value>* addnode  = new Node<Key, Value>(currentkey , replace , bstiter);
 					bstiter->setRight(addnode);
+					added = addnode;
+					++depth;
 					break;
 				}
 				bstiter = bstiter->getRight();
+				++depth;
 			}
 		}
 	}
 	else {
 		Node<Key, Value>* newroot = new Node<Key, Value>(currentkey, replace, NULL);
 		root_ = newroot;
+		added = newroot;
+	}
+	inserted = true;
+	noteInserted(added);
+	++size_;
+	if ( size_ > maxSize_ ) {
+		maxSize_ = size_;
 	}
+	//scapegoat mode: a node deeper than log base 1/alpha of the size means some ancestor is too lopsided
+	if ( alpha_ > 0 && depth > (int)(std::log((double)size_) / std::log(1.0 / alpha_)) ) {
+		rebuildScapegoat(added);
+	}
+	return added;
+}
+
+/**
+* Sets key to value, adding it if absent, in one descent. Returns an iterator
+* to the item and whether it was added.
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert_or_assign(const Key& key, const Value& value)
+{
+	bool inserted;
+	Node<Key, Value>* node = insertOrFindLive(key, value, inserted);
+	if ( !inserted ) {
+		node->setValue(value);
+		itemChanged(node);
+	}
+	iterator it(node);
+#ifdef BST_STATS
+	it.owner_ = this;
+#endif
+	return std::make_pair(it, inserted);
+}
+
+/**
+* Calls fn(value) on the value stored for key, first adding key with a
+* default-constructed Value if it is absent, in one descent. Returns the value.
+*   counts.upsert(word, [](int& n) { ++n; });
+*/
+template<class Key, class Value>
+template<typename Fn>
+Value& BinarySearchTree<Key, Value>::upsert(const Key& key, Fn fn)
+{
+	bool inserted;
+	Node<Key, Value>* node = insertOrFindLive(key, Value(), inserted);
+	fn(node->getValue());
+	itemChanged(node);
+	return node->getValue();
+}
+
+/**
+* Returns the value stored for key, adding a default-constructed one if it is
+* absent (like std::map::operator[]), in one descent.
+*/
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::getOrCreate(const Key& key)
+{
+	bool inserted;
+	return insertOrFindLive(key, Value(), inserted)->getValue();
+}
+
+/**
+* Returns a pointer to the value stored for key, or NULL; never throws.
+*/
+template<class Key, class Value>
+Value* BinarySearchTree<Key, Value>::tryGet(const Key& key)
+{
+	Node<Key, Value>* curr = internalFind(key);
+	return curr == NULL ? NULL : &curr->getValue();
+}
+
+template<class Key, class Value>
+const Value* BinarySearchTree<Key, Value>::tryGet(const Key& key) const
+{
+	Node<Key, Value>* curr = internalFind(key);
+	return curr == NULL ? NULL : &curr->getValue();
 }
 
 
@@ -485,90 +922,19 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 * A remove method to remove a specific key from a Binary Search Tree.
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
+* In lazy-delete mode the node is only marked (see setLazyDelete).
 */
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
-    // TODO
-		
-		
 		if ( root_ != NULL) {
 			Node<Key, Value> *remover = root_;
 			while ( true ) {
+			BST_STAT(++stats_.keyComparisons);
 			Key check = remover->getKey();
 			if ( check == key ) { //if we found the key
-				if ( remover->getLeft() == NULL && remover->getRight() == NULL ) { //if node has no childre
-					if ( remover == root_ ) {
-						root_ = NULL;
-						delete root_;
-						break;
-					}
-					Node<Key, Value> *parent = remover->getParent();
-					if ( parent->getRight() == remover ) { //if remover is right child
-						parent->setRight(NULL);
-					}
-					else if ( parent->getLeft() == remover ) { //if remover is left child
-						parent->setLeft(NULL);
-					}
-					remover->setParent(NULL);
-					delete remover;
-					break;
-				}
-				else if ( remover->getLeft() == NULL || remover->getRight() == NULL ) { //if node has one child
-					if ( remover->getLeft() == NULL ) { //if the left node is NULL, right child exists
-						Node<Key, Value> *rightchild = remover->getRight();
-						if ( remover->getParent() == NULL ) { //checking if the current node is the root_
-							root_ = rightchild;
-							rightchild->setParent(NULL);
-							remover->setParent(NULL);	//remove locations of remover
-							remover->setRight(NULL);
-							break;
-						}
-						Node<Key, Value> *parent = remover->getParent();
-						if ( remover == parent->getRight() ) { //if remover is the left child of its parent
-							parent->setRight(rightchild);
-							rightchild->setParent(parent);
-						}	
-						else{ //if remover is the right child of its parent
-							parent->setLeft(rightchild);
-							rightchild->setParent(parent);
-							
-						}		
-						remover->setParent(NULL);	//remove locations of remover
-						remover->setRight(NULL);
-					}
-					else if ( remover->getRight() == NULL ) { //if the right node is NULL, left child exists
-						Node<Key, Value> *leftchild = remover->getLeft();
-						if ( remover->getParent() == NULL ) { //checking if the current node is the root_
-							root_ = leftchild;
-							leftchild->setParent(NULL);
-							remover->setParent(NULL);	//remove locations of remover
-							remover->setLeft(NULL);
-							break;
-						}
-						Node<Key, Value> *parent = remover->getParent();
-						if ( remover == parent->getRight() ) { //if remover is the left child of its parent
-							parent->setRight(leftchild);
-							leftchild->setParent(parent);		
-						}	
-						else{ //if remover is the right child of its parent
-							parent->setLeft(leftchild);
-							leftchild->setParent(parent);
-						}	
-						remover->setParent(NULL); //remove locations of remover
-						remover->setLeft(NULL);	
-					}
-					delete remover;
-					break;
-				}
-				else { //if node has both children
-					Node<Key, Value> *pred = predecessor(remover);
-					
-					nodeSwap(remover, pred); //remover goes to pred, and pred goes to remover node position
-					//if you use pred, node you switch with only has left child or no child
-
-					remove(remover->getKey());
-				}
+				removeFound(remover);
+				break;
 			}
 			else if ( key < check ) { //if the current key  node is less than remover key
 				if ( remover->getLeft() == NULL ) {
@@ -587,7 +953,308 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 			}
 		}	
 	}
-	
+}
+
+/**
+* Unlinks and deletes a node that is known to be in the tree; remove() once
+* the key is found, popMin()/popMax() directly.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* remover)
+{
+		noteRemoving(remover);
+		if ( remover->getLeft() != NULL && remover->getRight() != NULL ) { //if node has both children
+			Node<Key, Value> *pred = predecessor(remover);
+			nodeSwap(remover, pred); //remover goes to pred, and pred goes to remover node position
+			//if you use pred, node you switch with only has left child or no child
+		}
+		if ( remover->getLeft() == NULL && remover->getRight() == NULL ) { //if node has no childre
+			if ( remover == root_ ) {
+				root_ = NULL;
+			}
+			else {
+				Node<Key, Value> *parent = remover->getParent();
+				if ( parent->getRight() == remover ) { //if remover is right child
+					parent->setRight(NULL);
+				}
+				else if ( parent->getLeft() == remover ) { //if remover is left child
+					parent->setLeft(NULL);
+				}
+				remover->setParent(NULL);
+			}
+		}
+		else { //if node has one child
+			Node<Key, Value> *child = remover->getLeft() == NULL ? remover->getRight() : remover->getLeft();
+			Node<Key, Value> *parent = remover->getParent();
+			if ( parent == NULL ) { //checking if the current node is the root_
+				root_ = child;
+			}
+			else if ( remover == parent->getRight() ) { //if remover is the right child of its parent
+				parent->setRight(child);
+			}
+			else { //if remover is the left child of its parent
+				parent->setLeft(child);
+			}
+			child->setParent(parent);
+			remover->setParent(NULL); //remove locations of remover
+			remover->setLeft(NULL);
+			remover->setRight(NULL);
+		}
+		delete remover;
+		--size_;
+		//scapegoat mode: once enough nodes are gone, rebuild the whole tree
+		if ( alpha_ > 0 && size_ < alpha_ * maxSize_ ) {
+			if ( root_ != NULL ) {
+				rebuildSubtree(root_, size_);
+			}
+			maxSize_ = size_;
+		}
+}
+
+/**
+* Keeps min_/max_ right when a new node was just linked under its parent:
+* it is the new minimum exactly when it became the old minimum's left child.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::noteInserted(Node<Key, Value>* added)
+{
+	Node<Key, Value>* parent = added->getParent();
+	if ( parent == NULL ) { //first node
+		min_ = added;
+		max_ = added;
+	}
+	else if ( parent == min_ && parent->getLeft() == added ) {
+		min_ = added;
+	}
+	else if ( parent == max_ && parent->getRight() == added ) {
+		max_ = added;
+	}
+}
+
+/**
+* Keeps min_/max_ and the tombstone count right when n is about to be removed;
+* called while n is still linked. Rotations, swaps and rebuilds move nodes but
+* never change which node holds the smallest or largest key, so only removal
+* needs this.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::noteRemoving(Node<Key, Value>* n)
+{
+	if ( n->isDeleted() ) {
+		--tombstones_;
+	}
+	if ( n == min_ ) {
+		min_ = successor(n);
+	}
+	if ( n == max_ ) {
+		max_ = predecessor(n);
+	}
+}
+
+/**
+* Recomputes min_/max_ by walking both spines, after surgery that changes
+* which nodes are in the tree (AVLTree::eraseRange, split, join). O(height).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetExtremes()
+{
+	min_ = getSmallestNode();
+	max_ = root_;
+	while ( max_ != NULL && max_->getRight() != NULL ) {
+		max_ = max_->getRight();
+	}
+}
+
+/**
+* Returns an iterator to the smallest item, end() if the tree is empty. O(1)
+* unless the smallest keys are tombstones (see setLazyDelete).
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::min() const
+{
+    return begin();
+}
+
+/**
+* Returns an iterator to the largest item, end() if the tree is empty. O(1)
+* unless the largest keys are tombstones.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::max() const
+{
+    BinarySearchTree<Key, Value>::iterator last(lastLive());
+#ifdef BST_STATS
+    last.owner_ = this;
+#endif
+    return last;
+}
+
+/**
+* Removes the smallest item and returns it, without searching for it.
+* Throws std::out_of_range if the tree is empty.
+*/
+template<typename Key, typename Value>
+std::pair<Key, Value> BinarySearchTree<Key, Value>::popMin()
+{
+	Node<Key, Value>* first = firstLive();
+	if ( first == NULL ) {
+		throw std::out_of_range("popMin on an empty tree");
+	}
+	std::pair<Key, Value> item(first->getKey(), first->getValue());
+	removeNode(first);
+	return item;
+}
+
+/**
+* Removes the largest item and returns it, without searching for it.
+* Throws std::out_of_range if the tree is empty.
+*/
+template<typename Key, typename Value>
+std::pair<Key, Value> BinarySearchTree<Key, Value>::popMax()
+{
+	Node<Key, Value>* last = lastLive();
+	if ( last == NULL ) {
+		throw std::out_of_range("popMax on an empty tree");
+	}
+	std::pair<Key, Value> item(last->getKey(), last->getValue());
+	removeNode(last);
+	return item;
+}
+
+/**
+* Smallest node that is not a tombstone, NULL if there is none. O(1) unless the
+* smallest keys have been lazily deleted.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::firstLive() const
+{
+	Node<Key, Value>* n = min_;
+	while ( n != NULL && n->isDeleted() ) {
+		n = successor(n);
+	}
+	return n;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::lastLive() const
+{
+	Node<Key, Value>* n = max_;
+	while ( n != NULL && n->isDeleted() ) {
+		n = predecessor(n);
+	}
+	return n;
+}
+
+/**
+* Lazy-delete mode: remove() only marks the node as a tombstone, in O(log n)
+* with no rotations or rebuilds, and find(), iteration and size() skip it.
+* Tombstones are purged by one O(n) rebuild once they make up more than
+* maxTombstoneRatio of the nodes, or whenever compact() is called. Inserting a
+* tombstoned key revives its node in place. Turning the mode off compacts.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setLazyDelete(bool enabled, double maxTombstoneRatio)
+{
+	if ( !enabled ) {
+		tombstoneRatio_ = 0;
+		compact();
+		return;
+	}
+	if ( maxTombstoneRatio <= 0.0 || maxTombstoneRatio > 1.0 ) {
+		throw std::invalid_argument("Tombstone ratio must be in (0, 1]");
+	}
+	tombstoneRatio_ = maxTombstoneRatio;
+}
+
+/**
+* Deletes every tombstone and relinks the remaining nodes into a balanced tree.
+* O(n); does nothing if there are no tombstones.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compact()
+{
+	if ( tombstones_ == 0 ) {
+		return;
+	}
+	std::vector<Node<Key, Value>*> live;
+	std::vector<Node<Key, Value>*> dead;
+	live.reserve(size_ - tombstones_);
+	for ( Node<Key, Value>* n = min_; n != NULL; n = successor(n) ) {
+		if ( n->isDeleted() ) {
+			dead.push_back(n);
+		}
+		else {
+			live.push_back(n);
+		}
+	}
+	for ( size_t i = 0; i < dead.size(); ++i ) { //only once the walk no longer needs their links
+		delete dead[i];
+	}
+	tombstones_ = 0;
+	rebuildFrom(live);
+}
+
+/**
+* Number of lazily deleted nodes still linked into the tree.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::tombstones() const
+{
+	return tombstones_;
+}
+
+/**
+* Links nodes, which are in key order and are every node of the tree, into a
+* balanced tree and resets size and extremes. AVLTree also resets balances.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuildFrom(std::vector<Node<Key, Value>*>& nodes)
+{
+	root_ = buildBalanced(nodes, 0, nodes.size(), NULL);
+	size_ = nodes.size();
+	maxSize_ = size_;
+	min_ = nodes.empty() ? NULL : nodes.front();
+	max_ = nodes.empty() ? NULL : nodes.back();
+}
+
+/**
+* insertOrFind for the public insert paths: a tombstone with the key is
+* revived with the new value and counts as inserted.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::insertOrFindLive(const Key& key, const Value& value, bool& inserted)
+{
+	Node<Key, Value>* node = insertOrFind(key, value, inserted);
+	if ( node->isDeleted() ) {
+		node->setDeleted(false);
+		node->setValue(value);
+		--tombstones_;
+		itemChanged(node);
+		inserted = true;
+	}
+	return node;
+}
+
+/**
+* Removes n, which remove() just found: marks it in lazy-delete mode (compacting
+* past the tombstone ratio), unlinks it otherwise.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeFound(Node<Key, Value>* n)
+{
+	if ( tombstoneRatio_ == 0 ) {
+		removeNode(n);
+		return;
+	}
+	if ( n->isDeleted() ) {
+		return;
+	}
+	n->setDeleted(true);
+	++tombstones_;
+	itemChanged(n);
+	if ( tombstones_ > tombstoneRatio_ * size_ ) {
+		compact();
+	}
 }
 
 
@@ -632,13 +1299,14 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
 
 template<class Key, class Value>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current, StatCounter* hops)
 {
 	//finding the very left most node in the right subtree of current node
 	//if no child, find the point when you go left, then the parent that is to the right is the successor
 	if (current->getRight() == NULL) { //go up since right subtree does not exist
 		while ( current ) {
 			Node<Key, Value> *temp = current->getParent(); 
+			BST_STAT(hops != NULL && ++*hops);
 			if ( temp == NULL ) { //if the temp ends up being the parent, there is no successor
 				return NULL;
 			}
@@ -682,6 +1350,11 @@ void BinarySearchTree<Key, Value>::clear()
 		//delete the node
 		noderemover(root_);
 		root_ = NULL;
+		min_ = NULL;
+		max_ = NULL;
+		size_ = 0;
+		tombstones_ = 0;
+		maxSize_ = 0;
 }
 
 template<typename Key, typename Value>
@@ -695,6 +1368,97 @@ void BinarySearchTree<Key, Value>::noderemover(Node<Key, Value>* current)
 	delete current;
 }
 
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::subtreeSize(Node<Key, Value>* current) const
+{
+	if ( current == NULL ) {
+		return 0;
+	}
+	return subtreeSize(current->getLeft()) + subtreeSize(current->getRight()) + 1;
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::subtreeTombstones(Node<Key, Value>* current) const
+{
+	if ( current == NULL ) {
+		return 0;
+	}
+	return subtreeTombstones(current->getLeft()) + subtreeTombstones(current->getRight()) + (current->isDeleted() ? 1 : 0);
+}
+
+/**
+* Scapegoat mode helper: walks up from a node that was inserted too deep and
+* rebuilds the subtree of the first ancestor that is not alpha-weight-balanced.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuildScapegoat(Node<Key, Value>* added)
+{
+	Node<Key, Value>* child = added;
+	Node<Key, Value>* current = added->getParent();
+	size_t childsize = 1;
+	while ( current != NULL ) {
+		Node<Key, Value>* sibling = current->getLeft() == child ? current->getRight() : current->getLeft();
+		size_t currentsize = childsize + subtreeSize(sibling) + 1;
+		if ( childsize > alpha_ * currentsize ) { //child holds too much of the subtree, current is the scapegoat
+			rebuildSubtree(current, currentsize);
+			return;
+		}
+		child = current;
+		childsize = currentsize;
+		current = current->getParent();
+	}
+}
+
+/**
+* Relinks the count nodes of the subtree rooted at top into a perfectly
+* balanced shape in O(count) time. No nodes are allocated or freed.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuildSubtree(Node<Key, Value>* top, size_t count)
+{
+	Node<Key, Value>* parent = top->getParent();
+	bool wasleft = parent != NULL && parent->getLeft() == top;
+	//collect the subtree in order, starting from its smallest node
+	std::vector<Node<Key, Value>*> nodes;
+	nodes.reserve(count);
+	Node<Key, Value>* current = top;
+	while ( current->getLeft() != NULL ) {
+		current = current->getLeft();
+	}
+	for ( size_t i = 0; i < count; ++i ) {
+		nodes.push_back(current);
+		current = successor(current);
+	}
+	Node<Key, Value>* newtop = buildBalanced(nodes, 0, count, parent);
+	if ( parent == NULL ) {
+		root_ = newtop;
+	}
+	else if ( wasleft ) {
+		parent->setLeft(newtop);
+	}
+	else {
+		parent->setRight(newtop);
+	}
+}
+
+/**
+* Links nodes[lo, hi) (in sorted order) into a balanced subtree under parent
+* and returns its root.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::buildBalanced(std::vector<Node<Key, Value>*>& nodes, size_t lo, size_t hi, Node<Key, Value>* parent)
+{
+	if ( lo >= hi ) {
+		return NULL;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	Node<Key, Value>* current = nodes[mid];
+	current->setParent(parent);
+	current->setLeft(buildBalanced(nodes, lo, mid, current));
+	current->setRight(buildBalanced(nodes, mid + 1, hi, current));
+	return current;
+}
+
 /**
 * A helper function to find the smallest node in the tree.
 */
@@ -704,7 +1468,7 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
 {
 	//the smallest value in a binary search tree will always be the most left node
 	Node<Key, Value>* current = root_;
-	while ( true) {
+	while ( current != NULL ) {
 		if ( current->getLeft() != NULL) {
 			current = current->getLeft();
 			continue;
@@ -724,9 +1488,17 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
 template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
 {
+		BST_STAT(++stats_.finds);
 		if (root_ != NULL ) {
 			Node <Key, Value>* current = root_;
+#ifdef BST_STATS
+			unsigned long long visited = 0;
+#endif
 			while ( true ) {
+				BST_STAT(++stats_.keyComparisons);
+				BST_STAT(++stats_.findNodesVisited);
+				BST_STAT(++visited);
+				BST_STAT(stats_.maxFindDepth.raise(visited));
 				Key currentkey = current->getKey();
 				if ( key < currentkey ) { //if current key is less than key, move to left
 					if ( current->getLeft() == NULL ) {
@@ -741,7 +1513,7 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 					current = current->getRight();
 				}
 				else {
-					return current;
+					return current->isDeleted() ? NULL : current;
 					break;
 				}
 			}
@@ -758,6 +1530,254 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
 	return calculateheight(root_) != -1;
 }
 
+/**
+* Checks the whole tree in one iterative pass: keys strictly increasing in order,
+* every child's parent pointer pointing back, the node count matching size(),
+* and whatever the derived tree checks in verifyNode (AVLTree: stored balances).
+* O(n) time, O(height) space. On failure returns false and, if problem is not
+* NULL, describes the first violation found.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::verify(std::string* problem) const
+{
+	struct Frame {
+		Node<Key, Value>* node;
+		int leftHeight;
+		int state;
+	};
+	const char* error = NULL;
+	std::vector<Frame> stack;
+	if ( root_ != NULL ) {
+		if ( root_->getParent() != NULL ) {
+			error = "root has a parent";
+		}
+		Frame top = { root_, 0, 0 };
+		stack.push_back(top);
+	}
+	Node<Key, Value>* previous = NULL; //last node in key order
+	size_t count = 0;
+	size_t dead = 0;
+	int childHeight = 0;
+	while ( error == NULL && !stack.empty() ) {
+		Frame& f = stack.back();
+		Node<Key, Value>* n = f.node;
+		if ( f.state == 0 ) {
+			if ( ++count > size_ ) { //also stops a walk around a cycle
+				error = "more nodes than size()";
+				break;
+			}
+			f.state = 1;
+			if ( n->getLeft() != NULL ) {
+				if ( n->getLeft()->getParent() != n ) {
+					error = "left child's parent link is wrong";
+					break;
+				}
+				Frame child = { n->getLeft(), 0, 0 };
+				stack.push_back(child); //f is invalid from here on
+				continue;
+			}
+			childHeight = 0;
+		}
+		if ( f.state == 1 ) { //left subtree done, n is next in key order
+			if ( previous != NULL && !(previous->getKey() < n->getKey()) ) {
+				error = "keys out of order";
+				break;
+			}
+			previous = n;
+			if ( n->isDeleted() ) {
+				++dead;
+			}
+			f.leftHeight = childHeight;
+			f.state = 2;
+			if ( n->getRight() != NULL ) {
+				if ( n->getRight()->getParent() != n ) {
+					error = "right child's parent link is wrong";
+					break;
+				}
+				Frame child = { n->getRight(), 0, 0 };
+				stack.push_back(child);
+				continue;
+			}
+			childHeight = 0;
+		}
+		error = verifyNode(n, f.leftHeight, childHeight);
+		childHeight = 1 + std::max(f.leftHeight, childHeight);
+		stack.pop_back();
+	}
+	if ( error == NULL && count != size_ ) {
+		error = "fewer nodes than size()";
+	}
+	if ( error == NULL && dead != tombstones_ ) {
+		error = "tombstone count is wrong";
+	}
+	if ( error != NULL && problem != NULL ) {
+		*problem = error;
+	}
+	return error == NULL;
+}
+
+/**
+* Checks paths random root-to-leaf paths: parent links, keys within the bounds
+* set by their ancestors, and the derived tree's verifyNodeLocal. O(paths * height),
+* so it can run continuously; it only finds problems on the paths it walks. The
+* paths come from a call-local xorshift seeded off a shared atomic counter, so
+* every call walks different paths and concurrent readers do not race.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::verifySample(size_t paths, std::string* problem) const
+{
+	static std::atomic<unsigned long long> calls(0);
+	unsigned long long state = (calls.fetch_add(1, std::memory_order_relaxed) + 1) * 0x9E3779B97F4A7C15ULL; //odd multiplier, never 0
+	const char* error = NULL;
+	if ( root_ != NULL && root_->getParent() != NULL ) {
+		error = "root has a parent";
+	}
+	for ( size_t path = 0; error == NULL && path < paths && root_ != NULL; ++path ) {
+		Node<Key, Value>* low = NULL;  //nearest ancestor the path went right from
+		Node<Key, Value>* high = NULL; //nearest ancestor the path went left from
+		Node<Key, Value>* current = root_;
+		for ( size_t depth = 0; current != NULL; ++depth ) {
+			if ( depth > size_ ) {
+				error = "path longer than size()";
+				break;
+			}
+			if ( (low != NULL && !(low->getKey() < current->getKey())) ||
+			     (high != NULL && !(current->getKey() < high->getKey())) ) {
+				error = "key outside its ancestors' range";
+				break;
+			}
+			if ( (current->getLeft() != NULL && current->getLeft()->getParent() != current) ||
+			     (current->getRight() != NULL && current->getRight()->getParent() != current) ) {
+				error = "child's parent link is wrong";
+				break;
+			}
+			error = verifyNodeLocal(current);
+			if ( error != NULL ) {
+				break;
+			}
+			state ^= state << 13; //xorshift64
+			state ^= state >> 7;
+			state ^= state << 17;
+			bool goLeft = current->getRight() == NULL || (current->getLeft() != NULL && (state & 1));
+			if ( goLeft ) {
+				high = current;
+				current = current->getLeft();
+			}
+			else {
+				low = current;
+				current = current->getRight();
+			}
+		}
+	}
+	if ( error != NULL && problem != NULL ) {
+		*problem = error;
+	}
+	return error == NULL;
+}
+
+/**
+* Restructures the tree in place into a complete tree using the Day-Stout-Warren
+* algorithm: O(n) time, O(1) extra space. Nodes are only relinked, never
+* reallocated, so references to keys/values and iterators stay valid.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+	//tree to vine: rotate left children up until the tree is a right-leaning list
+	size_t count = 0;
+	Node<Key, Value>* rest = root_;
+	while ( rest != NULL ) {
+		Node<Key, Value>* left = rest->getLeft();
+		if ( left != NULL ) {
+			rotateNodeRight(rest);
+			rest = left;
+		}
+		else {
+			++count;
+			rest = rest->getRight();
+		}
+	}
+	//vine to tree: first fold the nodes that do not fit in a perfect tree, then halve the spine repeatedly
+	size_t full = 1;
+	while ( full * 2 + 1 <= count ) {
+		full = full * 2 + 1;
+	}
+	if ( count > 0 ) {
+		compressVine(count - full);
+	}
+	while ( full > 1 ) {
+		full /= 2;
+		compressVine(full);
+	}
+	maxSize_ = size_;
+}
+
+/**
+* DSW helper: left-rotates every other node on the right spine, count times.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compressVine(size_t count)
+{
+	Node<Key, Value>* current = root_;
+	for ( size_t i = 0; i < count; ++i ) {
+		Node<Key, Value>* next = current->getRight();
+		rotateNodeLeft(current);
+		current = next->getRight();
+	}
+}
+
+/**
+* Rotates n's right child up into n's position.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotateNodeLeft(Node<Key, Value>* n)
+{
+	Node<Key, Value>* nright = n->getRight();
+	Node<Key, Value>* nparent = n->getParent();
+	if ( nparent == NULL ) {
+		root_ = nright;
+	}
+	else if ( nparent->getLeft() == n ) {
+		nparent->setLeft(nright);
+	}
+	else {
+		nparent->setRight(nright);
+	}
+	nright->setParent(nparent);
+	n->setRight(nright->getLeft());
+	if ( nright->getLeft() != NULL ) {
+		nright->getLeft()->setParent(n);
+	}
+	nright->setLeft(n);
+	n->setParent(nright);
+}
+
+/**
+* Rotates n's left child up into n's position.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotateNodeRight(Node<Key, Value>* n)
+{
+	Node<Key, Value>* nleft = n->getLeft();
+	Node<Key, Value>* nparent = n->getParent();
+	if ( nparent == NULL ) {
+		root_ = nleft;
+	}
+	else if ( nparent->getLeft() == n ) {
+		nparent->setLeft(nleft);
+	}
+	else {
+		nparent->setRight(nleft);
+	}
+	nleft->setParent(nparent);
+	n->setLeft(nleft->getRight());
+	if ( nleft->getRight() != NULL ) {
+		nleft->getRight()->setParent(n);
+	}
+	nleft->setRight(n);
+	n->setParent(nleft);
+}
+
 template<typename Key, typename Value>
 int BinarySearchTree<Key, Value>::calculateheight(Node<Key, Value> *root) const
 {
@@ -883,6 +1903,9 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 // include print function (in its own file because it's fairly long)
 #include "print_bst.h"
 
+// shape analysis and Graphviz/JSON export, for trees too big to print
+#include "shape_bst.h"
+
 /*
 ---------------------------------------------------
 End implementations for the BinarySearchTree class.
@@ -0,0 +1,320 @@
+#ifndef COMBINING_H
+#define COMBINING_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* Hands out small per-thread indices, reused after a thread exits, so that
+* flat-combining structures can give every thread its own slot in a fixed
+* array. Threads beyond MAX_THREADS get none and fall back to plain locking.
+*/
+class CombiningThreadIndex
+{
+public:
+    static const unsigned MAX_THREADS = 128;
+    static const unsigned NONE = ~0u;
+
+    // The calling thread's index, NONE if all are taken
+    static unsigned local();
+    // One more than the highest index ever handed out
+    static unsigned highWater() { return state().highWater.load(std::memory_order_acquire); }
+
+private:
+    struct State
+    {
+        std::mutex lock;
+        std::vector<unsigned> released;
+        std::atomic<unsigned> highWater;
+        State() : highWater(0) { }
+    };
+    struct Holder
+    {
+        unsigned index;
+        Holder();
+        ~Holder();
+    };
+
+    static State& state()
+    {
+        static State shared;
+        return shared;
+    }
+};
+
+inline CombiningThreadIndex::Holder::Holder()
+{
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    if(!s.released.empty()) {
+        index = s.released.back();
+        s.released.pop_back();
+    }
+    else if(s.highWater.load(std::memory_order_relaxed) < MAX_THREADS) {
+        index = s.highWater.load(std::memory_order_relaxed);
+        s.highWater.store(index + 1, std::memory_order_release);
+    }
+    else {
+        index = NONE;
+    }
+}
+
+inline CombiningThreadIndex::Holder::~Holder()
+{
+    if(index != NONE) {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.released.push_back(index);
+    }
+}
+
+inline unsigned CombiningThreadIndex::local()
+{
+    static thread_local Holder holder;
+    return holder.index;
+}
+
+/**
+* A flat-combining front end for one shared AVLTree. Instead of every thread
+* taking the lock for its own small operation, a thread publishes the
+* operation in its slot and spins on it; whichever thread gets the lock
+* collects every published operation, sorts them by key, so neighbouring
+* operations descend through nodes that are already in cache, applies them
+* and marks each slot done. The lock changes hands once per batch instead of
+* once per operation, and the tree is only touched by one core at a time.
+* The tree itself is not changed.
+*
+* Operations from different threads that are pending together are concurrent,
+* so applying them in key order is linearizable. An exception thrown while
+* applying an operation is rethrown in the thread that asked for it.
+*/
+template <typename Key, typename Value>
+class CombiningAVLTree
+{
+public:
+    CombiningAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    // Copies the value out if the key is there
+    bool find(const Key& key, Value& value);
+    bool contains(const Key& key);
+    size_t size();
+
+    // Runs fn(tree) under the combiner lock, for anything the slots do not cover
+    template <typename Fn>
+    void withTree(Fn fn);
+
+    // Heap instances keep the slots on cache-line boundaries; plain new only
+    // promises that for over-aligned types from C++17 on
+    static void* operator new(size_t bytes);
+    static void operator delete(void* p) { free(p); }
+
+private:
+    enum SlotState { SLOT_EMPTY, SLOT_PENDING, SLOT_DONE };
+    enum SlotOp { OP_INSERT, OP_REMOVE, OP_FIND, OP_CONTAINS };
+
+    // Points at the caller's arguments, which live until the slot is done
+    struct Slot
+    {
+        std::atomic<int> state;
+        int op;
+        const Key* key;
+        const Value* value;
+        Value* out;
+        bool found;
+        std::exception_ptr error;
+
+        Slot() : state(SLOT_EMPTY), op(OP_INSERT), key(NULL), value(NULL), out(NULL), found(false) { }
+    };
+    // One slot per cache line, so spinning waiters do not disturb each other
+    struct alignas(64) PaddedSlot
+    {
+        Slot slot;
+    };
+
+    static const int MAX_PASSES = 3;
+
+    bool run(int op, const Key& key, const Value* value, Value* out);
+    void combine();
+    void apply(Slot& slot);
+
+    std::mutex lock_;
+    AVLTree<Key, Value> tree_;
+    std::vector<Slot*> batch_;  // reused by each combiner, guarded by lock_
+    PaddedSlot slots_[CombiningThreadIndex::MAX_THREADS];
+
+    CombiningAVLTree(const CombiningAVLTree&);
+    CombiningAVLTree& operator=(const CombiningAVLTree&);
+};
+
+template <typename Key, typename Value>
+CombiningAVLTree<Key, Value>::CombiningAVLTree()
+{
+    batch_.reserve(CombiningThreadIndex::MAX_THREADS);
+}
+
+template <typename Key, typename Value>
+void* CombiningAVLTree<Key, Value>::operator new(size_t bytes)
+{
+    void* p = NULL;
+    if(posix_memalign(&p, alignof(CombiningAVLTree<Key, Value>), bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+template <typename Key, typename Value>
+void CombiningAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    run(OP_INSERT, keyValuePair.first, &keyValuePair.second, NULL);
+}
+
+template <typename Key, typename Value>
+void CombiningAVLTree<Key, Value>::remove(const Key& key)
+{
+    run(OP_REMOVE, key, NULL, NULL);
+}
+
+template <typename Key, typename Value>
+bool CombiningAVLTree<Key, Value>::find(const Key& key, Value& value)
+{
+    return run(OP_FIND, key, NULL, &value);
+}
+
+template <typename Key, typename Value>
+bool CombiningAVLTree<Key, Value>::contains(const Key& key)
+{
+    return run(OP_CONTAINS, key, NULL, NULL);
+}
+
+template <typename Key, typename Value>
+size_t CombiningAVLTree<Key, Value>::size()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return tree_.size();
+}
+
+template <typename Key, typename Value>
+template <typename Fn>
+void CombiningAVLTree<Key, Value>::withTree(Fn fn)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    fn(tree_);
+}
+
+/**
+* Publishes the operation and waits until some combiner, possibly this
+* thread, has applied it. Returns the found flag for lookups.
+*/
+template <typename Key, typename Value>
+bool CombiningAVLTree<Key, Value>::run(int op, const Key& key, const Value* value, Value* out)
+{
+    unsigned index = CombiningThreadIndex::local();
+    if(index == CombiningThreadIndex::NONE) { //no slot: take the lock like a plain mutex
+        Slot direct;
+        direct.op = op;
+        direct.key = &key;
+        direct.value = value;
+        direct.out = out;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            apply(direct);
+        }
+        if(direct.error) {
+            std::rethrow_exception(direct.error);
+        }
+        return direct.found;
+    }
+    Slot& slot = slots_[index].slot;
+    slot.op = op;
+    slot.key = &key;
+    slot.value = value;
+    slot.out = out;
+    slot.state.store(SLOT_PENDING, std::memory_order_release);
+    for(unsigned spins = 0; slot.state.load(std::memory_order_acquire) != SLOT_DONE; ++spins) {
+        if(lock_.try_lock()) {
+            combine(); //always covers our own slot, published before we took the lock
+            lock_.unlock();
+        }
+        else if(spins % 64 == 63) {
+            std::this_thread::yield(); //the combiner may need our core
+        }
+    }
+    slot.state.store(SLOT_EMPTY, std::memory_order_relaxed);
+    if(slot.error) {
+        std::exception_ptr error = slot.error;
+        slot.error = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+    return slot.found;
+}
+
+/**
+* Called with lock_ held. Collects the pending slots, applies them in key
+* order and releases their threads; repeats while passes keep finding work,
+* up to MAX_PASSES, to make the most of holding the lock.
+*/
+template <typename Key, typename Value>
+void CombiningAVLTree<Key, Value>::combine()
+{
+    for(int pass = 0; pass < MAX_PASSES; ++pass) {
+        batch_.clear();
+        unsigned count = CombiningThreadIndex::highWater();
+        for(unsigned i = 0; i < count; ++i) {
+            Slot& slot = slots_[i].slot;
+            if(slot.state.load(std::memory_order_acquire) == SLOT_PENDING) {
+                batch_.push_back(&slot);
+            }
+        }
+        if(batch_.empty()) {
+            return;
+        }
+        std::sort(batch_.begin(), batch_.end(), [](const Slot* a, const Slot* b) { return *a->key < *b->key; });
+        for(size_t i = 0; i < batch_.size(); ++i) {
+            apply(*batch_[i]);
+        }
+        for(size_t i = 0; i < batch_.size(); ++i) {
+            batch_[i]->state.store(SLOT_DONE, std::memory_order_release);
+        }
+    }
+}
+
+template <typename Key, typename Value>
+void CombiningAVLTree<Key, Value>::apply(Slot& slot)
+{
+    try {
+        switch(slot.op) {
+        case OP_INSERT:
+            tree_.insert(std::pair<const Key, Value>(*slot.key, *slot.value));
+            break;
+        case OP_REMOVE:
+            tree_.remove(*slot.key);
+            break;
+        case OP_FIND: {
+            Value* found = tree_.tryGet(*slot.key);
+            slot.found = found != NULL;
+            if(found != NULL) {
+                *slot.out = *found;
+            }
+            break;
+        }
+        default:
+            slot.found = tree_.tryGet(*slot.key) != NULL;
+            break;
+        }
+    }
+    catch(...) {
+        slot.error = std::current_exception();
+    }
+}
+
+#endif
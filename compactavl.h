@@ -0,0 +1,279 @@
+#ifndef COMPACTAVL_H
+#define COMPACTAVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include "avlcore.h"
+
+/**
+* A node for CompactAVLTree. Unlike AVLNode it has no virtual functions (so no
+* vtable pointer) and keeps the balance in the two low bits of the parent
+* pointer, which are always zero because nodes are at least 4-byte aligned.
+* An AVLNode<int,int> takes 48 bytes; a CompactAVLNode<int,int> takes 32.
+*/
+template <typename Key, typename Value>
+class CompactAVLNode
+{
+public:
+    CompactAVLNode(const Key& key, const Value& value, CompactAVLNode<Key, Value>* parent);
+
+    const std::pair<const Key, Value>& getItem() const { return item_; }
+    std::pair<const Key, Value>& getItem() { return item_; }
+    const Key& getKey() const { return item_.first; }
+    const Value& getValue() const { return item_.second; }
+    Value& getValue() { return item_.second; }
+    void setValue(const Value& value) { item_.second = value; }
+
+    CompactAVLNode<Key, Value>* getParent() const;
+    CompactAVLNode<Key, Value>* getLeft() const { return left_; }
+    CompactAVLNode<Key, Value>* getRight() const { return right_; }
+    int8_t getBalance() const;
+
+    void setParent(CompactAVLNode<Key, Value>* parent);
+    void setLeft(CompactAVLNode<Key, Value>* left) { left_ = left; }
+    void setRight(CompactAVLNode<Key, Value>* right) { right_ = right; }
+    void setBalance(int8_t balance);
+
+protected:
+    std::pair<const Key, Value> item_;
+    uintptr_t parentAndBalance_;    // parent pointer | (balance + 1)
+    CompactAVLNode<Key, Value>* left_;
+    CompactAVLNode<Key, Value>* right_;
+};
+
+template<class Key, class Value>
+CompactAVLNode<Key, Value>::CompactAVLNode(const Key& key, const Value& value, CompactAVLNode<Key, Value>* parent) :
+    item_(key, value),
+    parentAndBalance_(reinterpret_cast<uintptr_t>(parent) | 1),
+    left_(NULL),
+    right_(NULL)
+{
+    static_assert(alignof(CompactAVLNode<Key, Value>) >= 4, "balance bits need 4-byte aligned nodes");
+}
+
+template<class Key, class Value>
+CompactAVLNode<Key, Value>* CompactAVLNode<Key, Value>::getParent() const
+{
+    return reinterpret_cast<CompactAVLNode<Key, Value>*>(parentAndBalance_ & ~(uintptr_t)3);
+}
+
+template<class Key, class Value>
+int8_t CompactAVLNode<Key, Value>::getBalance() const
+{
+    return (int8_t)(parentAndBalance_ & 3) - 1;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setParent(CompactAVLNode<Key, Value>* parent)
+{
+    parentAndBalance_ = reinterpret_cast<uintptr_t>(parent) | (parentAndBalance_ & 3);
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setBalance(int8_t balance)
+{
+    parentAndBalance_ = (parentAndBalance_ & ~(uintptr_t)3) | (uintptr_t)(balance + 1);
+}
+
+/**
+* An AVL tree with the same interface as AVLTree, built from CompactAVLNodes.
+* The balancing is the shared logic in avlcore.h.
+*/
+template <typename Key, typename Value>
+class CompactAVLTree
+{
+public:
+    typedef CompactAVLNode<Key, Value>* NodeRef;
+
+    CompactAVLTree();
+    ~CompactAVLTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+
+    class iterator
+    {
+    public:
+        iterator() : current_(NULL) { }
+
+        std::pair<const Key, Value>& operator*() const { return current_->getItem(); }
+        std::pair<const Key, Value>* operator->() const { return &(current_->getItem()); }
+
+        bool operator==(const iterator& rhs) const { return current_ == rhs.current_; }
+        bool operator!=(const iterator& rhs) const { return current_ != rhs.current_; }
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(const CompactAVLTree<Key, Value>* tree, NodeRef ptr) : tree_(tree), current_(ptr) { }
+        const CompactAVLTree<Key, Value>* tree_;
+        NodeRef current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    friend struct AVLAlgorithms<CompactAVLTree<Key, Value> >;
+    typedef AVLAlgorithms<CompactAVLTree<Key, Value> > Balancer;
+
+    // Link accessors used by AVLAlgorithms
+    NodeRef nil() const { return NULL; }
+    NodeRef getRoot() const { return root_; }
+    void setRoot(NodeRef n) { root_ = n; }
+    NodeRef getParent(NodeRef n) const { return n->getParent(); }
+    NodeRef getLeft(NodeRef n) const { return n->getLeft(); }
+    NodeRef getRight(NodeRef n) const { return n->getRight(); }
+    void setParent(NodeRef n, NodeRef p) { n->setParent(p); }
+    void setLeft(NodeRef n, NodeRef l) { n->setLeft(l); }
+    void setRight(NodeRef n, NodeRef r) { n->setRight(r); }
+    int8_t getBalance(NodeRef n) const { return n->getBalance(); }
+    void setBalance(NodeRef n, int8_t b) { n->setBalance(b); }
+    const Key& getKey(NodeRef n) const { return n->getKey(); }
+
+    void noderemover(NodeRef current);
+
+    NodeRef root_;
+    size_t size_;
+
+private:
+    CompactAVLTree(const CompactAVLTree&);
+    CompactAVLTree& operator=(const CompactAVLTree&);
+};
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator&
+CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    current_ = Balancer::successor(*tree_, current_);
+    return *this;
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::CompactAVLTree() : root_(NULL), size_(0)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::~CompactAVLTree()
+{
+    clear();
+}
+
+/**
+* Same semantics as AVLTree::insert: an existing key has its value overwritten.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+	const Key& key = keyValuePair.first;
+	NodeRef parent = NULL;
+	NodeRef current = root_;
+	bool left = false;
+	while ( current != NULL ) {
+		parent = current;
+		if ( key < current->getKey() ) {
+			current = current->getLeft();
+			left = true;
+		}
+		else if ( current->getKey() < key ) {
+			current = current->getRight();
+			left = false;
+		}
+		else { //key already in the tree, overwrite the value
+			current->setValue(keyValuePair.second);
+			return;
+		}
+	}
+	NodeRef addnode = new CompactAVLNode<Key, Value>(key, keyValuePair.second, parent);
+	Balancer::link(*this, parent, addnode, left);
+	++size_;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::remove(const Key& key)
+{
+	NodeRef remover = Balancer::find(*this, key);
+	if ( remover == NULL ) {
+		return;
+	}
+	Balancer::unlink(*this, remover);
+	delete remover;
+	--size_;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+	noderemover(root_);
+	root_ = NULL;
+	size_ = 0;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::noderemover(NodeRef current)
+{
+	if ( current == NULL ) {
+		return;
+	}
+	noderemover(current->getLeft());
+	noderemover(current->getRight());
+	delete current;
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<class Key, class Value>
+size_t CompactAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::begin() const
+{
+    return iterator(this, Balancer::minimum(*this, root_));
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::end() const
+{
+    return iterator(this, NULL);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, Balancer::find(*this, key));
+}
+
+template<class Key, class Value>
+Value& CompactAVLTree<Key, Value>::operator[](const Key& key)
+{
+    NodeRef curr = Balancer::find(*this, key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+template<class Key, class Value>
+Value const & CompactAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    NodeRef curr = Balancer::find(*this, key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+
+/*
+  Epoch-based memory reclamation for lock-free structures.
+
+  A thread reads shared nodes only inside an EpochGuard, which announces the
+  global epoch it entered in. A node that has been made unreachable is handed
+  to retire() instead of being deleted; it is freed once the global epoch has
+  moved on twice, because by then every thread that could still hold a pointer
+  to it has left its guard. The global epoch only advances when every thread
+  inside a guard has announced the current epoch, so a thread that stays in a
+  guard holds back reclamation for everyone (but never blocks them).
+
+  There is one domain per process, shared by every structure that uses it.
+  Each thread takes a record from a lock-free list on first use and gives it
+  back when it exits; records are reused, never freed.
+*/
+
+class EpochDomain
+{
+public:
+    static const uint64_t QUIESCENT = ~(uint64_t)0;
+    // Retirements between attempts to advance the epoch and free old nodes
+    static const size_t COLLECT_EVERY = 64;
+
+    struct Record
+    {
+        std::atomic<uint64_t> epoch;   // announced epoch, QUIESCENT outside any guard
+        std::atomic<bool> inUse;
+        Record* next;                  // immutable once the record is published
+        unsigned nesting;              // owner thread only, like everything below
+        size_t sinceCollect;
+        struct Retired
+        {
+            void* object;
+            void (*destroy)(void*);
+            uint64_t epoch;
+        };
+        std::deque<Retired> limbo;     // in retire order, so in epoch order
+
+        Record() : epoch(QUIESCENT), inUse(true), next(NULL), nesting(0), sinceCollect(0) { }
+    };
+
+    static EpochDomain& instance();
+
+    // The calling thread's record, taken on first use
+    Record* local();
+    void enter(Record* record);
+    void leave(Record* record);
+    // Frees object with destroy(object) once no guard can still see it
+    void retire(void* object, void (*destroy)(void*));
+
+private:
+    EpochDomain() : epoch_(0), records_(NULL) { }
+
+    Record* acquire();
+    void release(Record* record);
+    bool tryAdvance();
+    void collect(Record* record);
+
+    struct ThreadSlot
+    {
+        Record* record;
+        ThreadSlot() : record(NULL) { }
+        ~ThreadSlot();
+    };
+
+    std::atomic<uint64_t> epoch_;
+    std::atomic<Record*> records_;
+
+    EpochDomain(const EpochDomain&);
+    EpochDomain& operator=(const EpochDomain&);
+};
+
+/**
+* Pins the calling thread's epoch for its lifetime. Guards nest, and copying
+* one pins again, so an object holding a guard can be copied freely on the
+* thread that created it; it must not be handed to another thread.
+*/
+class EpochGuard
+{
+public:
+    EpochGuard() : record_(EpochDomain::instance().local())
+    {
+        EpochDomain::instance().enter(record_);
+    }
+    EpochGuard(const EpochGuard& other) : record_(other.record_)
+    {
+        if(record_ != NULL) {
+            EpochDomain::instance().enter(record_);
+        }
+    }
+    EpochGuard& operator=(const EpochGuard& other)
+    {
+        if(other.record_ != NULL) {
+            EpochDomain::instance().enter(other.record_);
+        }
+        if(record_ != NULL) {
+            EpochDomain::instance().leave(record_);
+        }
+        record_ = other.record_;
+        return *this;
+    }
+    ~EpochGuard()
+    {
+        if(record_ != NULL) {
+            EpochDomain::instance().leave(record_);
+        }
+    }
+
+    // An empty guard that pins nothing, for objects that do not read shared nodes
+    static EpochGuard none() { return EpochGuard(NULL); }
+
+private:
+    explicit EpochGuard(EpochDomain::Record* record) : record_(record) { }
+
+    EpochDomain::Record* record_;
+};
+
+inline EpochDomain& EpochDomain::instance()
+{
+    static EpochDomain domain;
+    return domain;
+}
+
+inline EpochDomain::ThreadSlot::~ThreadSlot()
+{
+    if(record != NULL) {
+        EpochDomain::instance().release(record);
+    }
+}
+
+inline EpochDomain::Record* EpochDomain::local()
+{
+    static thread_local ThreadSlot slot;
+    if(slot.record == NULL) {
+        slot.record = acquire();
+    }
+    return slot.record;
+}
+
+inline EpochDomain::Record* EpochDomain::acquire()
+{
+    for(Record* r = records_.load(std::memory_order_acquire); r != NULL; r = r->next) {
+        bool free = false;
+        if(!r->inUse.load(std::memory_order_relaxed) && r->inUse.compare_exchange_strong(free, true)) {
+            return r; //reuse a record, limbo included, left by a thread that exited
+        }
+    }
+    Record* r = new Record;
+    Record* head = records_.load(std::memory_order_relaxed);
+    do {
+        r->next = head;
+    } while(!records_.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+    return r;
+}
+
+inline void EpochDomain::release(Record* record)
+{
+    tryAdvance();
+    collect(record);
+    record->inUse.store(false, std::memory_order_release);
+}
+
+inline void EpochDomain::enter(Record* record)
+{
+    if(record->nesting++ == 0) {
+        record->epoch.store(epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // the announcement must be visible before any shared pointer is read
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline void EpochDomain::leave(Record* record)
+{
+    if(--record->nesting == 0) {
+        record->epoch.store(QUIESCENT, std::memory_order_release);
+    }
+}
+
+inline void EpochDomain::retire(void* object, void (*destroy)(void*))
+{
+    Record* record = local();
+    Record::Retired retired = { object, destroy, epoch_.load(std::memory_order_acquire) };
+    record->limbo.push_back(retired);
+    if(++record->sinceCollect >= COLLECT_EVERY) {
+        record->sinceCollect = 0;
+        tryAdvance();
+        collect(record);
+    }
+}
+
+/**
+* Moves the global epoch on by one if every thread inside a guard has
+* announced the current one.
+*/
+inline bool EpochDomain::tryAdvance()
+{
+    uint64_t current = epoch_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for(Record* r = records_.load(std::memory_order_acquire); r != NULL; r = r->next) {
+        uint64_t announced = r->epoch.load(std::memory_order_acquire);
+        if(announced != QUIESCENT && announced != current) {
+            return false;
+        }
+    }
+    return epoch_.compare_exchange_strong(current, current + 1);
+}
+
+inline void EpochDomain::collect(Record* record)
+{
+    uint64_t current = epoch_.load(std::memory_order_acquire);
+    while(!record->limbo.empty() && record->limbo.front().epoch + 2 <= current) {
+        Record::Retired retired = record->limbo.front();
+        record->limbo.pop_front();
+        retired.destroy(retired.object);
+    }
+}
+
+#endif
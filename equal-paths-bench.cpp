@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include "equal-paths.h"
+#include "equal-paths-parallel.h"
+using namespace std;
+
+// Perfect tree in heap order: children of i are 2i+1 and 2i+2
+void buildPerfect(vector<Node>& nodes, int n)
+{
+    nodes.clear();
+    nodes.reserve(n);
+    for(int i = 0; i < n; ++i) {
+        nodes.push_back(Node(i));
+    }
+    for(int i = 0; 2 * i + 2 < n; ++i) {
+        nodes[i].left = &nodes[2 * i + 1];
+        nodes[i].right = &nodes[2 * i + 2];
+    }
+}
+
+// Best of a few runs, in ms
+double timeCheck(Node* root, unsigned threads, bool& result)
+{
+    double best = 0;
+    for(int run = 0; run < 5; ++run) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        result = threads == 0 ? equalPaths(root) : equalPathsParallel(root, threads);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if(run == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int levels = argc > 1 ? atoi(argv[1]) : 22;
+    vector<Node> nodes;
+    buildPerfect(nodes, (1 << levels) - 1);
+
+    bool result;
+    double sequentialMs = timeCheck(&nodes[0], 0, result);
+    cout << "n = " << nodes.size() << ", " << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << fixed << setprecision(2)
+         << "sequential   " << setw(8) << sequentialMs << " ms  (" << result << ")" << endl;
+
+    unsigned maxThreads = thread::hardware_concurrency();
+    if(maxThreads < 4) {
+        maxThreads = 4;
+    }
+    for(unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        double ms = timeCheck(&nodes[0], threads, result);
+        cout << "threads " << setw(3) << threads << "  " << setw(8) << ms << " ms  speedup "
+             << setw(5) << sequentialMs / ms << "  (" << result << ")" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "equal-paths-parallel.h"
+using namespace std;
+
+
+namespace {
+
+typedef pair<Node*, int> Task; //subtree root and its depth
+
+// nodes walked between looks at the cancel flag and at idle threads (power of two)
+const long CHECK_INTERVAL = 256;
+// nodes walked on the calling thread before the pool is started
+const long SEQUENTIAL_NODES = 1 << 14;
+
+struct Worker {
+	mutex lock;
+	deque<Task> tasks; //owner pops at the back, thieves take from the front
+};
+
+class ParallelCheck {
+public:
+	explicit ParallelCheck(unsigned threads);
+	long walk(deque<Task>& stack, long budget, int self);
+	void run(deque<Task>& seed);
+	bool mismatch() const { return mismatch_.load(); }
+
+private:
+	void work(int self);
+	bool take(int self, Task& task);
+	bool leaf(int depth);
+
+	vector<Worker> workers_;
+	atomic<int> leafDepth_;  //depth of the first leaf seen, -1 before that
+	atomic<bool> mismatch_;  //set once any path disagrees, cancels every worker
+	atomic<long> pending_;   //tasks queued or being walked
+	atomic<int> idle_;       //workers looking for a task
+};
+
+ParallelCheck::ParallelCheck(unsigned threads) :
+	workers_(threads), leafDepth_(-1), mismatch_(false), pending_(0), idle_(0)
+{
+
+}
+
+// Records a leaf at depth; false if another leaf already has a different depth
+bool ParallelCheck::leaf(int depth)
+{
+	int expected = -1;
+	if ( leafDepth_.compare_exchange_strong(expected, depth) ) {
+		return true;
+	}
+	return expected == depth;
+}
+
+// Depth-first walk of the tasks on stack until it is empty, a mismatch is found
+// or (budget >= 0) about budget nodes were visited. A worker (self >= 0) hands
+// its shallowest pending subtree to its queue whenever some thread is idle.
+long ParallelCheck::walk(deque<Task>& stack, long budget, int self)
+{
+	long visited = 0;
+	while ( !stack.empty() ) {
+		if ( (++visited & (CHECK_INTERVAL - 1)) == 0 ) {
+			if ( mismatch_.load(memory_order_relaxed) ) {
+				return visited;
+			}
+			if ( budget >= 0 && visited >= budget ) {
+				return visited;
+			}
+			if ( self >= 0 && stack.size() > 1 && idle_.load(memory_order_relaxed) > 0 ) {
+				pending_.fetch_add(1); //before it is visible, so pending_ never reads 0 early
+				lock_guard<mutex> guard(workers_[self].lock);
+				workers_[self].tasks.push_back(stack.front());
+				stack.pop_front();
+			}
+		}
+		Node* current = stack.back().first;
+		int depth = stack.back().second;
+		stack.pop_back();
+		if ( current->left == nullptr && current->right == nullptr ) {
+			if ( !leaf(depth) ) {
+				mismatch_.store(true);
+				return visited;
+			}
+			continue;
+		}
+		int known = leafDepth_.load(memory_order_relaxed);
+		if ( known != -1 && depth >= known ) { //every leaf below is too deep
+			mismatch_.store(true);
+			return visited;
+		}
+		if ( current->right != nullptr ) {
+			stack.push_back(make_pair(current->right, depth + 1));
+		}
+		if ( current->left != nullptr ) {
+			stack.push_back(make_pair(current->left, depth + 1));
+		}
+	}
+	return visited;
+}
+
+// Pops the newest task of worker self, or steals the oldest task of another worker
+bool ParallelCheck::take(int self, Task& task)
+{
+	{
+		lock_guard<mutex> guard(workers_[self].lock);
+		if ( !workers_[self].tasks.empty() ) {
+			task = workers_[self].tasks.back();
+			workers_[self].tasks.pop_back();
+			return true;
+		}
+	}
+	for ( size_t i = 1; i < workers_.size(); ++i ) {
+		Worker& victim = workers_[(self + i) % workers_.size()];
+		lock_guard<mutex> guard(victim.lock);
+		if ( !victim.tasks.empty() ) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ParallelCheck::work(int self)
+{
+	deque<Task> stack;
+	bool hungry = false;
+	Task task;
+	while ( !mismatch_.load(memory_order_relaxed) ) {
+		if ( take(self, task) ) {
+			if ( hungry ) {
+				idle_.fetch_sub(1);
+				hungry = false;
+			}
+			stack.push_back(task);
+			walk(stack, -1, self);
+			stack.clear();
+			pending_.fetch_sub(1);
+		}
+		else if ( pending_.load() == 0 ) { //nothing queued and nobody walking
+			break;
+		}
+		else {
+			if ( !hungry ) {
+				idle_.fetch_add(1);
+				hungry = true;
+			}
+			this_thread::yield();
+		}
+	}
+	if ( hungry ) {
+		idle_.fetch_sub(1);
+	}
+}
+
+// Deals the seed tasks out round-robin and runs worker 0 on the calling thread
+void ParallelCheck::run(deque<Task>& seed)
+{
+	pending_.store((long)seed.size());
+	for ( size_t i = 0; i < seed.size(); ++i ) {
+		workers_[i % workers_.size()].tasks.push_back(seed[i]);
+	}
+	vector<thread> threads;
+	for ( size_t i = 1; i < workers_.size(); ++i ) {
+		threads.push_back(thread(&ParallelCheck::work, this, (int)i));
+	}
+	work(0);
+	for ( size_t i = 0; i < threads.size(); ++i ) {
+		threads[i].join();
+	}
+}
+
+}
+
+bool equalPathsParallel(Node * root, unsigned threads)
+{
+	if ( threads == 0 ) {
+		threads = thread::hardware_concurrency();
+	}
+	if ( threads <= 1 ) {
+		return equalPaths(root);
+	}
+	ParallelCheck check(threads);
+	deque<Task> stack;
+	if ( root != nullptr ) {
+		stack.push_back(make_pair(root, 0));
+	}
+	check.walk(stack, SEQUENTIAL_NODES, -1); //small trees finish here
+	if ( !stack.empty() && !check.mismatch() ) {
+		check.run(stack);
+	}
+	return !check.mismatch();
+}
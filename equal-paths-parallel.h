@@ -0,0 +1,19 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+#include "equal-paths.h"
+
+/**
+ * @brief Same result as equalPaths, computed by a pool of threads
+ *
+ *        The first nodes are walked on the calling thread, so small trees never
+ *        start the pool. The rest is split into subtree tasks on per-thread
+ *        queues; idle threads steal the largest pending subtree from a busy one.
+ *        The first leaf reached fixes the expected depth for every thread, and
+ *        all threads stop as soon as any leaf disagrees.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of threads to use, 0 for one per hardware thread
+ */
+bool equalPathsParallel(Node * root, unsigned threads = 0);
+
+#endif
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <cstdlib>
+#include <vector>
+#include <chrono>
 #include "equal-paths.h"
+#include "equal-paths-parallel.h"
 using namespace std;
 
 
@@ -55,6 +58,57 @@ void test5(const char* msg)
   cout << msg << ": " <<   equalPaths(a) << endl;
 }
 
+// Million-node cases: times equalPaths on nodes stored in one vector
+void timeLarge(const char* msg, std::vector<Node>& nodes)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  bool result = equalPaths(&nodes[0]);
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+  cout << msg << ": " << result << " (" << nodes.size() << " nodes, " << elapsed.count() << " ms)" << endl;
+
+  start = chrono::steady_clock::now();
+  result = equalPathsParallel(&nodes[0], 4);
+  elapsed = chrono::steady_clock::now() - start;
+  cout << msg << " parallel: " << result << " (" << elapsed.count() << " ms)" << endl;
+}
+
+// Perfect tree in heap order: children of i are 2i+1 and 2i+2
+void buildPerfect(std::vector<Node>& nodes, int n)
+{
+  nodes.clear();
+  for(int i = 0; i < n; ++i) {
+    nodes.push_back(Node(i));
+  }
+  for(int i = 0; 2 * i + 2 < n; ++i) {
+    nodes[i].left = &nodes[2 * i + 1];
+    nodes[i].right = &nodes[2 * i + 2];
+  }
+}
+
+void testLarge()
+{
+  std::vector<Node> nodes;
+  nodes.reserve(1 << 20);
+
+  buildPerfect(nodes, (1 << 20) - 1);
+  timeLarge("Perfect", nodes);
+
+  // the last leaf gets one child, one leaf is now deeper than the rest
+  nodes.push_back(Node(-1));
+  nodes[nodes.size() - 2].left = &nodes.back();
+  timeLarge("Perfect plus one", nodes);
+
+  // a single path of a million nodes; one leaf, so the paths are equal
+  nodes.clear();
+  for(int i = 0; i < 1000000; ++i) {
+    nodes.push_back(Node(i));
+  }
+  for(int i = 0; i + 1 < 1000000; ++i) {
+    nodes[i].right = &nodes[i + 1];
+  }
+  timeLarge("Chain", nodes);
+}
+
 int main()
 {
   a = new Node(1);
@@ -67,6 +121,7 @@ int main()
   test3("Test3");
   test4("Test4");
   test5("Test5");
+  testLarge();
  
   delete a;
   delete b;
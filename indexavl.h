@@ -0,0 +1,333 @@
+#ifndef INDEXAVL_H
+#define INDEXAVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "avlcore.h"
+
+/**
+* One node of an IndexedAVLTree. Links are slot indices of type Index instead of
+* pointers, and the balance lives in the top two bits of the parent index, so an
+* <int,int> slot is 20 bytes with 32-bit indices. That caps a tree at 2^30 - 1
+* slots; stores that must go past it (MappedNodeStore) use 64-bit indices,
+* at 32 bytes for <int,int>. A slot on the free list keeps the next free index in
+* its parent field. Slots hold no pointers, so a block of them can be copied with
+* memcpy, written to a file or mapped into another process.
+*/
+template <typename Key, typename Value, typename Index = uint32_t>
+struct IndexedAVLSlot
+{
+    static const Index INDEX_MASK = (Index)~(Index)0 >> 2;
+    static const Index NIL = INDEX_MASK;  // also the maximum number of slots
+    static const int BALANCE_SHIFT = sizeof(Index) * 8 - 2;
+
+    std::pair<const Key, Value>& item() { return *reinterpret_cast<std::pair<const Key, Value>*>(&storage_); }
+    const std::pair<const Key, Value>& item() const { return *reinterpret_cast<const std::pair<const Key, Value>*>(&storage_); }
+
+    Index getParent() const { return parentAndBalance_ & INDEX_MASK; }
+    int8_t getBalance() const { return (int8_t)(parentAndBalance_ >> BALANCE_SHIFT) - 1; }
+    void setParent(Index parent) { parentAndBalance_ = (parentAndBalance_ & ~INDEX_MASK) | parent; }
+    void setBalance(int8_t balance) { parentAndBalance_ = (parentAndBalance_ & INDEX_MASK) | ((Index)(balance + 1) << BALANCE_SHIFT); }
+
+    typename std::aligned_storage<sizeof(std::pair<const Key, Value>), alignof(std::pair<const Key, Value>)>::type storage_;
+    Index parentAndBalance_;
+    Index left_;
+    Index right_;
+};
+
+template <typename Key, typename Value, typename Index>
+const Index IndexedAVLSlot<Key, Value, Index>::INDEX_MASK;
+template <typename Key, typename Value, typename Index>
+const Index IndexedAVLSlot<Key, Value, Index>::NIL;
+
+/**
+* The bookkeeping an IndexedAVLTree needs besides the slots themselves. It is
+* plain data so stores can keep it next to the slots (e.g. in a file header).
+*/
+template <typename Index = uint32_t>
+struct IndexedAVLHeader
+{
+    Index root;      // slot index of the root, NIL when empty
+    Index freeHead;  // first slot on the free list, NIL when none
+    Index used;      // slots handed out so far (live + free)
+    Index count;     // live entries
+};
+
+/**
+* The default slot store: one contiguous std::vector of slots plus a free list
+* of removed slots. Growth reallocates the vector, which is safe because nothing
+* refers to a slot by address.
+*/
+template <typename Key, typename Value>
+class VectorNodeStore
+{
+public:
+    typedef uint32_t Index;
+    typedef IndexedAVLSlot<Key, Value, Index> Slot;
+
+    VectorNodeStore();
+
+    Slot& slot(Index i) { return slots_[i]; }
+    const Slot& slot(Index i) const { return slots_[i]; }
+    IndexedAVLHeader<Index>& header() { return header_; }
+    const IndexedAVLHeader<Index>& header() const { return header_; }
+
+    Index allocate(const Key& key, const Value& value);
+    void release(Index i);
+    void clear();
+    void reserve(size_t n) { slots_.reserve(n); }
+
+    // Raw view of the slots, e.g. for writing a snapshot
+    const Slot* data() const { return slots_.data(); }
+    size_t bytes() const { return slots_.capacity() * sizeof(Slot) + sizeof(*this); }
+
+protected:
+    IndexedAVLHeader<Index> header_;
+    std::vector<Slot> slots_;
+};
+
+template <typename Key, typename Value>
+VectorNodeStore<Key, Value>::VectorNodeStore()
+{
+    clear();
+}
+
+template <typename Key, typename Value>
+typename VectorNodeStore<Key, Value>::Index VectorNodeStore<Key, Value>::allocate(const Key& key, const Value& value)
+{
+	Index i;
+	if ( header_.freeHead != Slot::NIL ) { //reuse a removed slot
+		i = header_.freeHead;
+		header_.freeHead = slots_[i].getParent();
+	}
+	else {
+		if ( header_.used == Slot::NIL ) {
+			throw std::length_error("IndexedAVLTree is full");
+		}
+		slots_.push_back(Slot());
+		i = header_.used++;
+	}
+	new (&slots_[i].storage_) std::pair<const Key, Value>(key, value);
+	++header_.count;
+	return i;
+}
+
+template <typename Key, typename Value>
+void VectorNodeStore<Key, Value>::release(Index i)
+{
+	slots_[i].item().~pair();
+	slots_[i].parentAndBalance_ = header_.freeHead;
+	header_.freeHead = i;
+	--header_.count;
+}
+
+template <typename Key, typename Value>
+void VectorNodeStore<Key, Value>::clear()
+{
+	slots_.clear();
+	header_.root = Slot::NIL;
+	header_.freeHead = Slot::NIL;
+	header_.used = 0;
+	header_.count = 0;
+}
+
+/**
+* An AVL tree whose nodes live in a slot store (a std::vector by default) and
+* link to each other by the store's Index type (32-bit for the vector).
+* Balancing is the shared AVLTree logic from avlcore.h and the interface
+* matches AVLTree. Because the tree contains no pointers it can be copied or
+* moved as raw bytes, and iterators (slot indices) survive store growth.
+*
+* Keys and values must be trivially copyable.
+*/
+template <typename Key, typename Value, typename Store = VectorNodeStore<Key, Value> >
+class IndexedAVLTree
+{
+public:
+    typedef typename Store::Index NodeRef;
+    typedef typename Store::Slot Slot;
+
+    IndexedAVLTree();
+    explicit IndexedAVLTree(const Store& store);
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+
+    // The underlying slots and header, for snapshots and relocation
+    const Store& store() const { return store_; }
+    Store& store() { return store_; }
+
+    class iterator
+    {
+    public:
+        iterator() : tree_(NULL), current_(Slot::NIL) { }
+
+        std::pair<const Key, Value>& operator*() const { return tree_->store_.slot(current_).item(); }
+        std::pair<const Key, Value>* operator->() const { return &(tree_->store_.slot(current_).item()); }
+
+        bool operator==(const iterator& rhs) const { return current_ == rhs.current_; }
+        bool operator!=(const iterator& rhs) const { return current_ != rhs.current_; }
+
+        iterator& operator++();
+
+    protected:
+        friend class IndexedAVLTree<Key, Value, Store>;
+        iterator(const IndexedAVLTree<Key, Value, Store>* tree, NodeRef index) :
+            tree_(const_cast<IndexedAVLTree<Key, Value, Store>*>(tree)), current_(index) { }
+        IndexedAVLTree<Key, Value, Store>* tree_;
+        NodeRef current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    friend struct AVLAlgorithms<IndexedAVLTree<Key, Value, Store> >;
+    typedef AVLAlgorithms<IndexedAVLTree<Key, Value, Store> > Balancer;
+
+    // Link accessors used by AVLAlgorithms
+    NodeRef nil() const { return Slot::NIL; }
+    NodeRef getRoot() const { return store_.header().root; }
+    void setRoot(NodeRef n) { store_.header().root = n; }
+    NodeRef getParent(NodeRef n) const { return store_.slot(n).getParent(); }
+    NodeRef getLeft(NodeRef n) const { return store_.slot(n).left_; }
+    NodeRef getRight(NodeRef n) const { return store_.slot(n).right_; }
+    void setParent(NodeRef n, NodeRef p) { store_.slot(n).setParent(p); }
+    void setLeft(NodeRef n, NodeRef l) { store_.slot(n).left_ = l; }
+    void setRight(NodeRef n, NodeRef r) { store_.slot(n).right_ = r; }
+    int8_t getBalance(NodeRef n) const { return store_.slot(n).getBalance(); }
+    void setBalance(NodeRef n, int8_t b) { store_.slot(n).setBalance(b); }
+    const Key& getKey(NodeRef n) const { return store_.slot(n).item().first; }
+
+    Store store_;
+};
+
+template<class Key, class Value, class Store>
+typename IndexedAVLTree<Key, Value, Store>::iterator&
+IndexedAVLTree<Key, Value, Store>::iterator::operator++()
+{
+    current_ = Balancer::successor(*tree_, current_);
+    return *this;
+}
+
+template<class Key, class Value, class Store>
+IndexedAVLTree<Key, Value, Store>::IndexedAVLTree()
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "IndexedAVLTree requires trivially copyable keys and values");
+}
+
+/**
+* Adopts an existing store, e.g. a copy of another tree's slots.
+*/
+template<class Key, class Value, class Store>
+IndexedAVLTree<Key, Value, Store>::IndexedAVLTree(const Store& store) : store_(store)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "IndexedAVLTree requires trivially copyable keys and values");
+}
+
+/**
+* Same semantics as AVLTree::insert: an existing key has its value overwritten.
+*/
+template<class Key, class Value, class Store>
+void IndexedAVLTree<Key, Value, Store>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+	const Key& key = keyValuePair.first;
+	NodeRef parent = Slot::NIL;
+	NodeRef current = getRoot();
+	bool left = false;
+	while ( current != Slot::NIL ) {
+		parent = current;
+		const Key& currentkey = getKey(current);
+		if ( key < currentkey ) {
+			current = getLeft(current);
+			left = true;
+		}
+		else if ( currentkey < key ) {
+			current = getRight(current);
+			left = false;
+		}
+		else { //key already in the tree, overwrite the value
+			store_.slot(current).item().second = keyValuePair.second;
+			return;
+		}
+	}
+	NodeRef addnode = store_.allocate(key, keyValuePair.second);
+	Balancer::link(*this, parent, addnode, left);
+}
+
+template<class Key, class Value, class Store>
+void IndexedAVLTree<Key, Value, Store>::remove(const Key& key)
+{
+	NodeRef remover = Balancer::find(*this, key);
+	if ( remover == Slot::NIL ) {
+		return;
+	}
+	Balancer::unlink(*this, remover);
+	store_.release(remover);
+}
+
+template<class Key, class Value, class Store>
+void IndexedAVLTree<Key, Value, Store>::clear()
+{
+    store_.clear();
+}
+
+template<class Key, class Value, class Store>
+bool IndexedAVLTree<Key, Value, Store>::empty() const
+{
+    return getRoot() == Slot::NIL;
+}
+
+template<class Key, class Value, class Store>
+size_t IndexedAVLTree<Key, Value, Store>::size() const
+{
+    return store_.header().count;
+}
+
+template<class Key, class Value, class Store>
+typename IndexedAVLTree<Key, Value, Store>::iterator IndexedAVLTree<Key, Value, Store>::begin() const
+{
+    return iterator(this, Balancer::minimum(*this, getRoot()));
+}
+
+template<class Key, class Value, class Store>
+typename IndexedAVLTree<Key, Value, Store>::iterator IndexedAVLTree<Key, Value, Store>::end() const
+{
+    return iterator(this, Slot::NIL);
+}
+
+template<class Key, class Value, class Store>
+typename IndexedAVLTree<Key, Value, Store>::iterator IndexedAVLTree<Key, Value, Store>::find(const Key& key) const
+{
+    return iterator(this, Balancer::find(*this, key));
+}
+
+template<class Key, class Value, class Store>
+Value& IndexedAVLTree<Key, Value, Store>::operator[](const Key& key)
+{
+    NodeRef curr = Balancer::find(*this, key);
+    if(curr == Slot::NIL) throw std::out_of_range("Invalid key");
+    return store_.slot(curr).item().second;
+}
+
+template<class Key, class Value, class Store>
+Value const & IndexedAVLTree<Key, Value, Store>::operator[](const Key& key) const
+{
+    NodeRef curr = Balancer::find(*this, key);
+    if(curr == Slot::NIL) throw std::out_of_range("Invalid key");
+    return store_.slot(curr).item().second;
+}
+
+#endif
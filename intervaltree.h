@@ -0,0 +1,276 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* What an IntervalTree stores under a start point: where the interval ends
+* and the user's value.
+*/
+template <typename Point, typename Value>
+struct IntervalEntry
+{
+    Point end;
+    Value value;
+
+    IntervalEntry() : end(), value() { }
+    IntervalEntry(const Point& e, const Value& v) : end(e), value(v) { }
+};
+
+template <typename Point, typename Value>
+std::ostream& operator<<(std::ostream& out, const IntervalEntry<Point, Value>& entry)
+{
+    return out << "..." << entry.end << " " << entry.value;
+}
+
+/**
+* An interval tree node: an AVLNode that also stores the largest end point
+* anywhere in its subtree.
+*/
+template <typename Point, typename Value>
+class IntervalNode : public AVLNode<Point, IntervalEntry<Point, Value> >
+{
+public:
+    IntervalNode(const Point& start, const IntervalEntry<Point, Value>& entry, AVLNode<Point, IntervalEntry<Point, Value> >* parent)
+        : AVLNode<Point, IntervalEntry<Point, Value> >(start, entry, parent), maxEnd_(entry.end) { }
+
+    const Point& getMaxEnd() const { return maxEnd_; }
+    void setMaxEnd(const Point& maxEnd) { maxEnd_ = maxEnd; }
+    void swapMaxEnd(IntervalNode<Point, Value>* other) { std::swap(maxEnd_, other->maxEnd_); }
+
+private:
+    Point maxEnd_;
+};
+
+/**
+* Closed intervals [start, end] keyed by start, one per start point, each with
+* a value. Items are (start, IntervalEntry) pairs. Every node keeps the largest
+* end in its subtree through the AVLTree augmentation hooks, so overlap
+* queries skip every subtree that ends before the query begins and, by key
+* order, every node that starts after it ends:
+*
+*   IntervalTree<int, Job> running;
+*   running.insert(10, 20, job);
+*   running.overlapping(15, 30, [](const IntervalTree<int, Job>::Item& i) { ... });
+*
+* A query reporting k intervals visits O((k + 1) log n) nodes at worst and
+* usually close to log n + k. Ends must not be written through iterators;
+* change an interval with insert or insert_or_assign. Lazily deleted nodes
+* keep their end in the subtree maxima until compacted but are not reported.
+*/
+template <typename Point, typename Value>
+class IntervalTree : public AVLTree<Point, IntervalEntry<Point, Value> >
+{
+public:
+    typedef IntervalEntry<Point, Value> Mapped;
+    typedef std::pair<const Point, Mapped> Item;
+
+    // Adds [start, end] or replaces the interval starting at start.
+    // Throws std::invalid_argument if end < start.
+    void insert(const Point& start, const Point& end, const Value& value);
+    virtual void insert(const Item& item);
+    std::pair<typename AVLTree<Point, Mapped>::iterator, bool> insert_or_assign(const Point& start, const Mapped& entry);
+
+    // Calls fn(item) for every interval overlapping [a, b], in start order;
+    // returns how many
+    template <typename Fn>
+    size_t overlapping(const Point& a, const Point& b, Fn fn) const;
+    // Calls fn(item) for every interval containing point, in start order
+    template <typename Fn>
+    size_t stabbing(const Point& point, Fn fn) const { return overlapping(point, point, fn); }
+
+    const Mapped* tryGet(const Point& start) const { return BinarySearchTree<Point, Mapped>::tryGet(start); }
+    const Mapped& operator[](const Point& start) const { return BinarySearchTree<Point, Mapped>::operator[](start); }
+    void split(const Point& start, IntervalTree<Point, Value>& right) { AVLTree<Point, Mapped>::split(start, right); }
+    void join(IntervalTree<Point, Value>& right) { AVLTree<Point, Mapped>::join(right); }
+    virtual void rebalance();
+
+protected:
+    typedef IntervalNode<Point, Value> INode;
+
+    virtual AVLNode<Point, Mapped>* newNode(const Point& start, const Mapped& entry, AVLNode<Point, Mapped>* parent);
+    virtual void refreshNode(AVLNode<Point, Mapped>* n);
+    virtual void refreshPath(AVLNode<Point, Mapped>* n);
+    virtual void itemChanged(Node<Point, Mapped>* n);
+    virtual void nodesSwapped(AVLNode<Point, Mapped>* n1, AVLNode<Point, Mapped>* n2);
+    virtual void rebuildFrom(std::vector<Node<Point, Mapped>*>& nodes);
+    virtual size_t nodeFootprint() const { return sizeof(INode); }
+    virtual const char* verifyNode(Node<Point, Mapped>* n, int leftHeight, int rightHeight) const;
+    virtual const char* verifyNodeLocal(Node<Point, Mapped>* n) const;
+
+private:
+    // would hand out an end point the subtree maxima cannot follow
+    using BinarySearchTree<Point, Mapped>::getOrCreate;
+    using BinarySearchTree<Point, Mapped>::upsert;
+
+    template <typename Fn>
+    void visit(Node<Point, Mapped>* n, const Point& a, const Point& b, Fn& fn, size_t& count) const;
+    const Point& subtreeMaxEnd(const Node<Point, Mapped>* n) const;
+    const char* verifyMaxEnd(const Node<Point, Mapped>* n) const;
+    void refreshAll(AVLNode<Point, Mapped>* n);
+};
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::insert(const Point& start, const Point& end, const Value& value)
+{
+    insert(Item(start, Mapped(end, value)));
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::insert(const Item& item)
+{
+    if(item.second.end < item.first) {
+        throw std::invalid_argument("interval ends before it starts");
+    }
+    AVLTree<Point, Mapped>::insert(item);
+}
+
+template <typename Point, typename Value>
+std::pair<typename AVLTree<Point, IntervalEntry<Point, Value> >::iterator, bool>
+IntervalTree<Point, Value>::insert_or_assign(const Point& start, const Mapped& entry)
+{
+    if(entry.end < start) {
+        throw std::invalid_argument("interval ends before it starts");
+    }
+    return BinarySearchTree<Point, Mapped>::insert_or_assign(start, entry);
+}
+
+template <typename Point, typename Value>
+template <typename Fn>
+size_t IntervalTree<Point, Value>::overlapping(const Point& a, const Point& b, Fn fn) const
+{
+    size_t count = 0;
+    if(!(b < a)) {
+        visit(this->root_, a, b, fn, count);
+    }
+    return count;
+}
+
+/**
+* In-order walk of n's subtree that stops where nothing can overlap [a, b]:
+* a subtree whose largest end is before a, and the right side of a node that
+* starts after b.
+*/
+template <typename Point, typename Value>
+template <typename Fn>
+void IntervalTree<Point, Value>::visit(Node<Point, Mapped>* n, const Point& a, const Point& b, Fn& fn, size_t& count) const
+{
+    while(n != NULL && !(static_cast<INode*>(n)->getMaxEnd() < a)) {
+        visit(n->getLeft(), a, b, fn, count);
+        BST_STAT(++this->stats_.keyComparisons);
+        if(b < n->getKey()) {
+            return;
+        }
+        if(!n->isDeleted() && !(n->getValue().end < a)) {
+            fn(static_cast<const Item&>(n->getItem()));
+            ++count;
+        }
+        n = n->getRight();
+    }
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::rebalance()
+{
+    AVLTree<Point, Mapped>::rebalance();
+    refreshAll(static_cast<AVLNode<Point, Mapped>*>(this->root_));
+}
+
+template <typename Point, typename Value>
+AVLNode<Point, IntervalEntry<Point, Value> >* IntervalTree<Point, Value>::newNode(const Point& start, const Mapped& entry, AVLNode<Point, Mapped>* parent)
+{
+    return new INode(start, entry, parent);
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::refreshNode(AVLNode<Point, Mapped>* n)
+{
+    static_cast<INode*>(n)->setMaxEnd(subtreeMaxEnd(n));
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::refreshPath(AVLNode<Point, Mapped>* n)
+{
+    for(; n != NULL; n = n->getParent()) {
+        refreshNode(n);
+    }
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::itemChanged(Node<Point, Mapped>* n)
+{
+    refreshPath(static_cast<AVLNode<Point, Mapped>*>(n));
+}
+
+// Each position keeps the maximum of its subtree, which a swap does not change
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::nodesSwapped(AVLNode<Point, Mapped>* n1, AVLNode<Point, Mapped>* n2)
+{
+    static_cast<INode*>(n1)->swapMaxEnd(static_cast<INode*>(n2));
+}
+
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::rebuildFrom(std::vector<Node<Point, Mapped>*>& nodes)
+{
+    AVLTree<Point, Mapped>::rebuildFrom(nodes);
+    refreshAll(static_cast<AVLNode<Point, Mapped>*>(this->root_));
+}
+
+template <typename Point, typename Value>
+const char* IntervalTree<Point, Value>::verifyNode(Node<Point, Mapped>* n, int leftHeight, int rightHeight) const
+{
+    const char* error = AVLTree<Point, Mapped>::verifyNode(n, leftHeight, rightHeight);
+    return error != NULL ? error : verifyMaxEnd(n);
+}
+
+template <typename Point, typename Value>
+const char* IntervalTree<Point, Value>::verifyNodeLocal(Node<Point, Mapped>* n) const
+{
+    const char* error = AVLTree<Point, Mapped>::verifyNodeLocal(n);
+    return error != NULL ? error : verifyMaxEnd(n);
+}
+
+// The largest of n's own end and its children's stored maxima
+template <typename Point, typename Value>
+const Point& IntervalTree<Point, Value>::subtreeMaxEnd(const Node<Point, Mapped>* n) const
+{
+    const Point* maxEnd = &n->getValue().end;
+    const INode* left = static_cast<const INode*>(n->getLeft());
+    const INode* right = static_cast<const INode*>(n->getRight());
+    if(left != NULL && *maxEnd < left->getMaxEnd()) {
+        maxEnd = &left->getMaxEnd();
+    }
+    if(right != NULL && *maxEnd < right->getMaxEnd()) {
+        maxEnd = &right->getMaxEnd();
+    }
+    return *maxEnd;
+}
+
+template <typename Point, typename Value>
+const char* IntervalTree<Point, Value>::verifyMaxEnd(const Node<Point, Mapped>* n) const
+{
+    const Point& stored = static_cast<const INode*>(n)->getMaxEnd();
+    const Point& expected = subtreeMaxEnd(n);
+    if(stored < expected || expected < stored) {
+        return "stored maximum end does not match the subtree";
+    }
+    return NULL;
+}
+
+// Recomputes every maximum below n bottom-up, after a rebuild. O(n).
+template <typename Point, typename Value>
+void IntervalTree<Point, Value>::refreshAll(AVLNode<Point, Mapped>* n)
+{
+    if(n == NULL) {
+        return;
+    }
+    refreshAll(n->getLeft());
+    refreshAll(n->getRight());
+    refreshNode(n);
+}
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef INTRUSIVEAVL_H
+#define INTRUSIVEAVL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include "avlcore.h"
+
+/**
+* The links an object embeds once per IntrusiveAVLTree it can be in. Only the
+* tree touches them. Copying an object does not copy its links, so a copy
+* starts out unlinked.
+*/
+template <typename T>
+struct IntrusiveAVLHook
+{
+    T* parent;
+    T* left;
+    T* right;
+    int8_t balance;
+
+    IntrusiveAVLHook() : parent(NULL), left(NULL), right(NULL), balance(0) { }
+    IntrusiveAVLHook(const IntrusiveAVLHook&) : parent(NULL), left(NULL), right(NULL), balance(0) { }
+    IntrusiveAVLHook& operator=(const IntrusiveAVLHook&) { return *this; }
+};
+
+/**
+* An AVL tree over objects the caller owns, linked through the hook member
+* Hook of T and ordered by KeyOf()(object). Insert and remove never allocate
+* or copy: the tree is just the hooks, balanced by AVLAlgorithms, the same
+* rebalancing code AVLTree runs on. An object with several hooks can be in
+* several trees at once:
+*
+*   struct Job { int id; long deadline; IntrusiveAVLHook<Job> byId, byDeadline; };
+*   struct IdOf { int operator()(const Job& j) const { return j.id; } };
+*   IntrusiveAVLTree<Job, &Job::byId, IdOf> jobs;
+*
+* Keys are unique. The tree does not own the objects: each must stay put
+* and keep its key while linked, and must be removed (or the tree cleared)
+* before it is destroyed.
+*/
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+class IntrusiveAVLTree
+{
+public:
+    typedef T* NodeRef;
+    typedef decltype(std::declval<const KeyOf&>()(std::declval<const T&>())) KeyRef;  // what KeyOf returns, maybe a reference
+    typedef typename std::decay<KeyRef>::type Key;
+
+    explicit IntrusiveAVLTree(KeyOf keyOf = KeyOf());
+    // Unlinks every object that is still in the tree
+    ~IntrusiveAVLTree();
+
+    // Links object in unless its key is taken; returns the object holding the
+    // key and whether it was this one
+    std::pair<T*, bool> insert(T& object);
+    // Unlinks object, which must be in this tree. O(log n), no lookup.
+    void remove(T& object);
+    // Unlinks and returns the object with key, NULL if there is none
+    T* erase(const Key& key);
+    T* find(const Key& key) const;
+    // First object whose key is not less than key, NULL if there is none
+    T* lowerBound(const Key& key) const;
+    void clear();
+    bool empty() const { return root_ == NULL; }
+    size_t size() const { return size_; }
+
+    class iterator
+    {
+    public:
+        iterator() : tree_(NULL), current_(NULL) { }
+
+        T& operator*() const { return *current_; }
+        T* operator->() const { return current_; }
+
+        bool operator==(const iterator& rhs) const { return current_ == rhs.current_; }
+        bool operator!=(const iterator& rhs) const { return current_ != rhs.current_; }
+
+        iterator& operator++();
+
+    protected:
+        friend class IntrusiveAVLTree<T, Hook, KeyOf>;
+        iterator(const IntrusiveAVLTree<T, Hook, KeyOf>* tree, NodeRef ptr) : tree_(tree), current_(ptr) { }
+        const IntrusiveAVLTree<T, Hook, KeyOf>* tree_;
+        NodeRef current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    friend struct AVLAlgorithms<IntrusiveAVLTree<T, Hook, KeyOf> >;
+    typedef AVLAlgorithms<IntrusiveAVLTree<T, Hook, KeyOf> > Balancer;
+
+    // Link accessors used by AVLAlgorithms
+    NodeRef nil() const { return NULL; }
+    NodeRef getRoot() const { return root_; }
+    void setRoot(NodeRef n) { root_ = n; }
+    NodeRef getParent(NodeRef n) const { return (n->*Hook).parent; }
+    NodeRef getLeft(NodeRef n) const { return (n->*Hook).left; }
+    NodeRef getRight(NodeRef n) const { return (n->*Hook).right; }
+    void setParent(NodeRef n, NodeRef p) { (n->*Hook).parent = p; }
+    void setLeft(NodeRef n, NodeRef l) { (n->*Hook).left = l; }
+    void setRight(NodeRef n, NodeRef r) { (n->*Hook).right = r; }
+    int8_t getBalance(NodeRef n) const { return (n->*Hook).balance; }
+    void setBalance(NodeRef n, int8_t b) { (n->*Hook).balance = b; }
+    KeyRef getKey(NodeRef n) const { return keyOf_(*n); }
+
+    void unlinkAll(NodeRef current);
+
+    NodeRef root_;
+    size_t size_;
+    KeyOf keyOf_;
+
+private:
+    IntrusiveAVLTree(const IntrusiveAVLTree&);
+    IntrusiveAVLTree& operator=(const IntrusiveAVLTree&);
+};
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+typename IntrusiveAVLTree<T, Hook, KeyOf>::iterator&
+IntrusiveAVLTree<T, Hook, KeyOf>::iterator::operator++()
+{
+    current_ = Balancer::successor(*tree_, current_);
+    return *this;
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+IntrusiveAVLTree<T, Hook, KeyOf>::IntrusiveAVLTree(KeyOf keyOf) : root_(NULL), size_(0), keyOf_(keyOf)
+{
+
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+IntrusiveAVLTree<T, Hook, KeyOf>::~IntrusiveAVLTree()
+{
+    clear();
+}
+
+/**
+* The descent of CompactAVLTree::insert, except that a taken key leaves the
+* tree alone: the object already there is not ours to overwrite.
+*/
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+std::pair<T*, bool> IntrusiveAVLTree<T, Hook, KeyOf>::insert(T& object)
+{
+    Key key = keyOf_(object);
+    NodeRef parent = NULL;
+    NodeRef current = root_;
+    bool left = false;
+    while(current != NULL) {
+        parent = current;
+        if(key < keyOf_(*current)) {
+            current = getLeft(current);
+            left = true;
+        }
+        else if(keyOf_(*current) < key) {
+            current = getRight(current);
+            left = false;
+        }
+        else { //key already in the tree
+            return std::make_pair(current, false);
+        }
+    }
+    Balancer::link(*this, parent, &object, left);
+    ++size_;
+    return std::make_pair(&object, true);
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+void IntrusiveAVLTree<T, Hook, KeyOf>::remove(T& object)
+{
+    Balancer::unlink(*this, &object);
+    --size_;
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+T* IntrusiveAVLTree<T, Hook, KeyOf>::erase(const Key& key)
+{
+    NodeRef remover = Balancer::find(*this, key);
+    if(remover != NULL) {
+        remove(*remover);
+    }
+    return remover;
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+T* IntrusiveAVLTree<T, Hook, KeyOf>::find(const Key& key) const
+{
+    return Balancer::find(*this, key);
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+T* IntrusiveAVLTree<T, Hook, KeyOf>::lowerBound(const Key& key) const
+{
+    NodeRef bound = NULL;
+    NodeRef current = root_;
+    while(current != NULL) {
+        if(keyOf_(*current) < key) {
+            current = getRight(current);
+        }
+        else { //current qualifies, look for a smaller one on the left
+            bound = current;
+            current = getLeft(current);
+        }
+    }
+    return bound;
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+void IntrusiveAVLTree<T, Hook, KeyOf>::clear()
+{
+    unlinkAll(root_);
+    root_ = NULL;
+    size_ = 0;
+}
+
+// Resets the hooks below current so the objects can be linked again
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+void IntrusiveAVLTree<T, Hook, KeyOf>::unlinkAll(NodeRef current)
+{
+    if(current == NULL) {
+        return;
+    }
+    unlinkAll(getLeft(current));
+    unlinkAll(getRight(current));
+    setParent(current, NULL);
+    setLeft(current, NULL);
+    setRight(current, NULL);
+    setBalance(current, 0);
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+typename IntrusiveAVLTree<T, Hook, KeyOf>::iterator IntrusiveAVLTree<T, Hook, KeyOf>::begin() const
+{
+    return iterator(this, Balancer::minimum(*this, root_));
+}
+
+template <typename T, IntrusiveAVLHook<T> T::*Hook, typename KeyOf>
+typename IntrusiveAVLTree<T, Hook, KeyOf>::iterator IntrusiveAVLTree<T, Hook, KeyOf>::end() const
+{
+    return iterator(this, NULL);
+}
+
+#endif
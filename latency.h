@@ -0,0 +1,243 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+/**
+* A log-linear (HDR-style) histogram of latencies in nanoseconds. Values are
+* grouped by power of two and each power of two is split into 2^SUB_BITS linear
+* sub-buckets, so every recorded value is known to within 1/2^SUB_BITS (6.25%)
+* with a fixed array and no allocation. Recording is a few shifts and an
+* increment; histograms from different threads are combined with merge().
+*/
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram() { reset(); }
+
+    void record(uint64_t ns);
+    void merge(const LatencyHistogram& other);
+    void reset();
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+    // Smallest recorded value v such that p percent of the values are <= v
+    uint64_t percentile(double p) const;
+
+private:
+    static int bucketOf(uint64_t ns);
+    static uint64_t bucketLow(int bucket);
+    static uint64_t bucketHigh(int bucket);
+
+    uint64_t counts_[BUCKETS];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+inline int LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if(ns < (uint64_t)SUB_BUCKETS) {
+        return (int)ns; //small values are exact
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+inline uint64_t LatencyHistogram::bucketLow(int bucket)
+{
+    if(bucket < SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(bucket % SUB_BUCKETS);
+    return ((uint64_t)SUB_BUCKETS + sub) << (exponent - SUB_BITS);
+}
+
+inline uint64_t LatencyHistogram::bucketHigh(int bucket)
+{
+    if(bucket < SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    return bucketLow(bucket) + ((uint64_t)1 << (exponent - SUB_BITS)) - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+    ++counts_[bucketOf(ns)];
+    ++count_;
+    sum_ += ns;
+    if(ns > max_) {
+        max_ = ns;
+    }
+}
+
+inline void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for(int i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if(other.max_ > max_) {
+        max_ = other.max_;
+    }
+}
+
+inline void LatencyHistogram::reset()
+{
+    memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+inline uint64_t LatencyHistogram::percentile(double p) const
+{
+    if(count_ == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * count_ + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > count_) rank = count_;
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if(seen >= rank) {
+            uint64_t high = bucketHigh(i);
+            return high < max_ ? high : max_;
+        }
+    }
+    return max_;
+}
+
+enum LatencyOp
+{
+    LATENCY_INSERT,
+    LATENCY_REMOVE,
+    LATENCY_FIND,
+    LATENCY_CLEAR,
+    LATENCY_OPS
+};
+
+/**
+* One histogram per tree operation. Give each thread its own recorder (no
+* sharing, no atomics on the hot path) and merge them when reporting.
+*/
+class LatencyRecorder
+{
+public:
+    LatencyHistogram& histogram(LatencyOp op) { return histograms_[op]; }
+    const LatencyHistogram& histogram(LatencyOp op) const { return histograms_[op]; }
+
+    void merge(const LatencyRecorder& other)
+    {
+        for(int op = 0; op < LATENCY_OPS; ++op) {
+            histograms_[op].merge(other.histograms_[op]);
+        }
+    }
+
+    void reset()
+    {
+        for(int op = 0; op < LATENCY_OPS; ++op) {
+            histograms_[op].reset();
+        }
+    }
+
+    // Prints count, mean and p50/p90/p99/p99.9/p99.99/max in ns for each recorded operation
+    void report(std::ostream& out) const;
+
+private:
+    LatencyHistogram histograms_[LATENCY_OPS];
+};
+
+inline void LatencyRecorder::report(std::ostream& out) const
+{
+    static const char* names[LATENCY_OPS] = { "insert", "remove", "find", "clear" };
+    static const double percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+    static const char* labels[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+    std::ios::fmtflags flags(out.flags());
+    for(int op = 0; op < LATENCY_OPS; ++op) {
+        const LatencyHistogram& h = histograms_[op];
+        if(h.count() == 0) {
+            continue;
+        }
+        out << std::left << std::setw(7) << names[op] << std::right
+            << " n " << std::setw(9) << h.count()
+            << "  mean " << std::fixed << std::setprecision(0) << std::setw(6) << h.mean();
+        for(size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+            out << "  " << labels[i] << " " << std::setw(6) << h.percentile(percentiles[i]);
+        }
+        out << "  max " << h.max() << " ns" << std::endl;
+    }
+    out.flags(flags);
+}
+
+/**
+* Wraps a tree so that insert, remove, find and clear are timed into a
+* LatencyRecorder. The tree is used as-is; synchronizing access to a shared tree
+* is still up to the caller.
+*/
+template <typename Tree>
+class TimedTree
+{
+public:
+    TimedTree(Tree& tree, LatencyRecorder& recorder) : tree_(tree), recorder_(recorder) { }
+
+    template <typename Pair>
+    void insert(const Pair& keyValuePair)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        tree_.insert(keyValuePair);
+        record(LATENCY_INSERT, start);
+    }
+
+    template <typename Key>
+    void remove(const Key& key)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        tree_.remove(key);
+        record(LATENCY_REMOVE, start);
+    }
+
+    template <typename Key>
+    typename Tree::iterator find(const Key& key)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        typename Tree::iterator it = tree_.find(key);
+        record(LATENCY_FIND, start);
+        return it;
+    }
+
+    void clear()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        tree_.clear();
+        record(LATENCY_CLEAR, start);
+    }
+
+    Tree& tree() { return tree_; }
+
+private:
+    void record(LatencyOp op, std::chrono::steady_clock::time_point start)
+    {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        recorder_.histogram(op).record((uint64_t)elapsed.count());
+    }
+
+    Tree& tree_;
+    LatencyRecorder& recorder_;
+};
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef MAPPEDAVL_H
+#define MAPPEDAVL_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "indexavl.h"
+
+/*
+  File layout of a MappedAVLTree:
+
+    MappedTreeFileHeader   64 or 128 bytes, includes the tree's root/free list/counts
+    slots                  capacity IndexedAVLSlots, linked by slot index
+
+  Every link is an index into the slot array, so the file means the same thing
+  wherever it is mapped and nothing has to be parsed or fixed up on open.
+*/
+
+static const char MAPPED_TREE_MAGIC[8] = { 'A', 'V', 'L', 'M', 'A', 'P', '\0', '\0' };
+static const uint32_t MAPPED_TREE_VERSION = 2;
+
+template <typename Index>
+struct alignas(64) MappedTreeFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint64_t capacity;      // slots the file currently has room for
+    uint32_t indexSize;     // sizeof(Index) of the links
+    uint32_t reserved;
+    IndexedAVLHeader<Index> tree;
+};
+
+/**
+* A slot store for IndexedAVLTree that lives in a shared, writable mapping of a
+* file. When it runs out of slots the file is extended and remapped; that is safe
+* because slots refer to each other by index, never by address. Links default to
+* 64 bits so a file can hold more than the 2^30 - 1 slots 32-bit links allow
+* (about 21 GB of <int,int> slots); with Index = uint32_t slots are smaller but
+* the file is full at that count.
+*/
+template <typename Key, typename Value, typename Link = uint64_t>
+class MappedNodeStore
+{
+public:
+    typedef Link Index;
+    typedef IndexedAVLSlot<Key, Value, Index> Slot;
+
+    MappedNodeStore();
+    ~MappedNodeStore();
+
+    // Opens path, creating an empty tree file if it does not exist yet
+    void open(const std::string& path, uint64_t initialCapacity);
+    void sync();
+    void close();
+
+    Slot& slot(Index i) { return slots()[i]; }
+    const Slot& slot(Index i) const { return slots()[i]; }
+    IndexedAVLHeader<Index>& header() { return fileHeader()->tree; }
+    const IndexedAVLHeader<Index>& header() const { return fileHeader()->tree; }
+
+    Index allocate(const Key& key, const Value& value);
+    void release(Index i);
+    void clear();
+    void reserve(size_t n);
+
+    uint64_t capacity() const { return fileHeader()->capacity; }
+    size_t bytes() const { return length_; }
+
+protected:
+    MappedTreeFileHeader<Index>* fileHeader() const { return reinterpret_cast<MappedTreeFileHeader<Index>*>(base_); }
+    Slot* slots() const { return reinterpret_cast<Slot*>(base_ + sizeof(MappedTreeFileHeader<Index>)); }
+    static size_t fileBytes(uint64_t capacity) { return sizeof(MappedTreeFileHeader<Index>) + capacity * sizeof(Slot); }
+    void grow(uint64_t capacity);
+
+    int fd_;
+    char* base_;
+    size_t length_;
+    std::string path_;
+
+private:
+    MappedNodeStore(const MappedNodeStore&);
+    MappedNodeStore& operator=(const MappedNodeStore&);
+};
+
+template <typename Key, typename Value, typename Link>
+MappedNodeStore<Key, Value, Link>::MappedNodeStore() : fd_(-1), base_(NULL), length_(0)
+{
+
+}
+
+template <typename Key, typename Value, typename Link>
+MappedNodeStore<Key, Value, Link>::~MappedNodeStore()
+{
+    close();
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::open(const std::string& path, uint64_t initialCapacity)
+{
+    close();
+    if(initialCapacity > Slot::NIL) {
+        throw std::length_error("MappedAVLTree capacity exceeds the slot index range");
+    }
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0) {
+        throw std::runtime_error("cannot open tree file " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if(::fstat(fd_, &st) != 0) {
+        close();
+        throw std::runtime_error("cannot stat tree file " + path + ": " + strerror(errno));
+    }
+
+    if(st.st_size == 0) { //new file, write an empty tree
+        if(initialCapacity == 0) initialCapacity = 1;
+        length_ = fileBytes(initialCapacity);
+        if(::ftruncate(fd_, length_) != 0) {
+            close();
+            throw std::runtime_error("cannot size tree file " + path + ": " + strerror(errno));
+        }
+    }
+    else {
+        length_ = (size_t)st.st_size;
+    }
+    void* mapped = ::mmap(NULL, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(mapped == MAP_FAILED) {
+        length_ = 0;
+        close();
+        throw std::runtime_error("cannot map tree file " + path + ": " + strerror(errno));
+    }
+    base_ = static_cast<char*>(mapped);
+
+    MappedTreeFileHeader<Index>* h = fileHeader();
+    if(st.st_size == 0) {
+        memcpy(h->magic, MAPPED_TREE_MAGIC, sizeof(h->magic));
+        h->version = MAPPED_TREE_VERSION;
+        h->slotSize = sizeof(Slot);
+        h->keySize = sizeof(Key);
+        h->valueSize = sizeof(Value);
+        h->capacity = initialCapacity;
+        h->indexSize = sizeof(Index);
+        h->reserved = 0;
+        clear();
+        return;
+    }
+    const char* error = NULL;
+    if(length_ < sizeof(MappedTreeFileHeader<Index>) || memcmp(h->magic, MAPPED_TREE_MAGIC, sizeof(h->magic)) != 0) error = "is not a tree file";
+    else if(h->version != MAPPED_TREE_VERSION) error = "has an unsupported version";
+    else if(h->indexSize != sizeof(Index)) error = "has a different slot index size";
+    else if(h->slotSize != sizeof(Slot) || h->keySize != sizeof(Key) || h->valueSize != sizeof(Value)) error = "holds a different key/value type";
+    else if(length_ < fileBytes(h->capacity)) error = "is truncated";
+    if(error != NULL) {
+        close();
+        throw std::runtime_error("tree file " + path + " " + error);
+    }
+}
+
+/**
+* Flushes every dirty page of the mapping to the file and waits for the write.
+*/
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::sync()
+{
+    if(base_ != NULL && ::msync(base_, length_, MS_SYNC) != 0) {
+        throw std::runtime_error("cannot sync tree file " + path_ + ": " + strerror(errno));
+    }
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::close()
+{
+    if(base_ != NULL) {
+        ::munmap(base_, length_);
+        base_ = NULL;
+    }
+    if(fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    length_ = 0;
+}
+
+/**
+* Extends the file to hold capacity slots and remaps it (possibly at a new address).
+* Throws std::length_error past Slot::NIL slots, the most an Index can link.
+*/
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::grow(uint64_t capacity)
+{
+    if(capacity > Slot::NIL) {
+        throw std::length_error("MappedAVLTree capacity exceeds the slot index range");
+    }
+    size_t newLength = fileBytes(capacity);
+    if(::ftruncate(fd_, newLength) != 0) {
+        throw std::runtime_error("cannot grow tree file " + path_ + ": " + strerror(errno));
+    }
+#ifdef MREMAP_MAYMOVE
+    void* mapped = ::mremap(base_, length_, newLength, MREMAP_MAYMOVE);
+#else
+    // map the new length before dropping the old mapping, so a failure leaves
+    // base_ and length_ valid
+    void* mapped = ::mmap(NULL, newLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+#endif
+    if(mapped == MAP_FAILED) {
+        throw std::runtime_error("cannot remap tree file " + path_ + ": " + strerror(errno));
+    }
+#ifndef MREMAP_MAYMOVE
+    ::munmap(base_, length_);
+#endif
+    base_ = static_cast<char*>(mapped);
+    length_ = newLength;
+    fileHeader()->capacity = capacity;
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::reserve(size_t n)
+{
+    if(n > capacity()) {
+        grow(n);
+    }
+}
+
+template <typename Key, typename Value, typename Link>
+typename MappedNodeStore<Key, Value, Link>::Index MappedNodeStore<Key, Value, Link>::allocate(const Key& key, const Value& value)
+{
+	IndexedAVLHeader<Index>& h = header();
+	Index i;
+	if ( h.freeHead != Slot::NIL ) { //reuse a removed slot
+		i = h.freeHead;
+		h.freeHead = slot(i).getParent();
+	}
+	else {
+		if ( h.used == Slot::NIL ) {
+			throw std::length_error("MappedAVLTree is full");
+		}
+		if ( h.used == capacity() ) { //double the file, header reference is stale after this
+			grow(std::min<uint64_t>(capacity() * 2, Slot::NIL));
+		}
+		i = header().used++;
+	}
+	new (&slot(i).storage_) std::pair<const Key, Value>(key, value);
+	++header().count;
+	return i;
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::release(Index i)
+{
+	slot(i).parentAndBalance_ = header().freeHead;
+	header().freeHead = i;
+	--header().count;
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedNodeStore<Key, Value, Link>::clear()
+{
+	IndexedAVLHeader<Index>& h = header();
+	h.root = Slot::NIL;
+	h.freeHead = Slot::NIL;
+	h.used = 0;
+	h.count = 0;
+}
+
+/**
+* An ordered map that lives in a file. Nodes are slots of a shared mapping and
+* link by index, and the balancing is the same AVL logic as IndexedAVLTree (and
+* AVLTree, via avlcore.h). Opening an existing file is just an mmap, so a large
+* index is usable immediately and the page cache brings in what lookups touch.
+*
+* Changes reach the file through the page cache; call sync() to force them to
+* disk. A crash between syncs can leave the file inconsistent.
+* Keys and values must be trivially copyable. With the default 64-bit links a
+* file holds up to 2^62 - 1 slots; MappedAVLTree<Key, Value, uint32_t> trades
+* that for smaller slots and a limit of 2^30 - 1.
+*/
+template <typename Key, typename Value, typename Link = uint64_t>
+class MappedAVLTree : public IndexedAVLTree<Key, Value, MappedNodeStore<Key, Value, Link> >
+{
+public:
+    explicit MappedAVLTree(const std::string& path, uint64_t initialCapacity = 1024);
+
+    void sync();
+    uint64_t capacity() const { return this->store_.capacity(); }
+};
+
+template <typename Key, typename Value, typename Link>
+MappedAVLTree<Key, Value, Link>::MappedAVLTree(const std::string& path, uint64_t initialCapacity)
+{
+    this->store_.open(path, initialCapacity);
+}
+
+template <typename Key, typename Value, typename Link>
+void MappedAVLTree<Key, Value, Link>::sync()
+{
+    this->store_.sync();
+}
+
+#endif
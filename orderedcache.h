@@ -0,0 +1,255 @@
+#ifndef ORDEREDCACHE_H
+#define ORDEREDCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* Which entry an OrderedCache drops when it is over capacity.
+*/
+enum EvictionPolicy
+{
+    EVICT_LRU,            // least recently read or written
+    EVICT_LFU,            // fewest reads and writes, least recent among ties
+    EVICT_SMALLEST_KEY,   // e.g. oldest timestamp
+    EVICT_LARGEST_KEY
+};
+
+/**
+* Counts every entry as one unit, so the capacity is a number of entries.
+*/
+struct CacheUnitWeight
+{
+    template <typename Key, typename Value>
+    size_t operator()(const Key&, const Value&) const { return 1; }
+};
+
+struct CacheCounters
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    CacheCounters() : hits(0), misses(0), evictions(0) { }
+};
+
+/**
+* What an OrderedCache stores per key: the value, its weight and the use
+* count and last-use tick that rank it for LRU/LFU eviction.
+*/
+template <typename Value>
+struct CacheEntry
+{
+    Value value;
+    size_t weight;
+    uint64_t uses;
+    uint64_t tick;
+
+    CacheEntry() : value(), weight(0), uses(0), tick(0) { }
+};
+
+template <typename Value>
+std::ostream& operator<<(std::ostream& out, const CacheEntry<Value>& entry)
+{
+    return out << entry.value;
+}
+
+/**
+* An ordered map that keeps its total weight under a capacity by evicting on
+* every put, so no outside sweeper is needed. Weigh(key, value) gives each
+* entry's weight: the default counts entries, a function returning byte sizes
+* makes it a memory budget:
+*
+*   struct Bytes { size_t operator()(int, const std::string& s) const { return sizeof(int) + s.size(); } };
+*   OrderedCache<int, std::string, Bytes> pages(64 << 20, EVICT_LRU);
+*
+* Lookups and puts are one AVLTree descent plus, for LRU and LFU, an
+* O(log n) update of the eviction order; evicting by key uses the tree's
+* cached extremes. scan() reads a key range in order without counting as use.
+* Not thread-safe: guard it with one lock, which get() needs anyway since it
+* updates the eviction order.
+*/
+template <typename Key, typename Value, typename Weigh = CacheUnitWeight>
+class OrderedCache
+{
+public:
+    explicit OrderedCache(size_t capacity, EvictionPolicy policy = EVICT_LRU, Weigh weigh = Weigh());
+
+    // Copies the value out and counts a hit if key is cached, else counts a miss
+    bool get(const Key& key, Value& value);
+    // Caches value under key, replacing what was there, then evicts until the
+    // total weight fits. Returns false if the entry did not stay cached: it
+    // weighs more than the whole capacity, or the policy evicted it.
+    bool put(const Key& key, const Value& value);
+    bool erase(const Key& key);
+    // Neither counts nor changes the eviction order
+    bool contains(const Key& key) const;
+    // Calls fn(key, value) for every cached key with lo <= key < hi, in key order
+    template <typename Fn>
+    void scan(const Key& lo, const Key& hi, Fn fn) const;
+
+    // Evicts right away if the cache is now over capacity
+    void setCapacity(size_t capacity);
+    void clear();
+    size_t size() const { return entries_.size(); }
+    size_t weight() const { return weight_; }
+    size_t capacity() const { return capacity_; }
+    EvictionPolicy policy() const { return policy_; }
+    CacheCounters counters() const { return counters_; }
+    void resetCounters() { counters_ = CacheCounters(); }
+
+private:
+    typedef CacheEntry<Value> Entry;
+    typedef std::pair<uint64_t, uint64_t> Rank;  // (uses, tick), lowest evicted first
+
+    bool ranked() const { return policy_ == EVICT_LRU || policy_ == EVICT_LFU; }
+    void touch(const Key& key, Entry& entry);
+    void evictToFit();
+
+    AVLTree<Key, Entry> entries_;
+    std::map<Rank, Key> ranks_;  // LRU and LFU only
+    size_t capacity_;
+    size_t weight_;
+    uint64_t clock_;
+    EvictionPolicy policy_;
+    Weigh weigh_;
+    CacheCounters counters_;
+
+    OrderedCache(const OrderedCache&);
+    OrderedCache& operator=(const OrderedCache&);
+};
+
+template <typename Key, typename Value, typename Weigh>
+OrderedCache<Key, Value, Weigh>::OrderedCache(size_t capacity, EvictionPolicy policy, Weigh weigh)
+    : capacity_(capacity), weight_(0), clock_(0), policy_(policy), weigh_(weigh)
+{
+}
+
+template <typename Key, typename Value, typename Weigh>
+bool OrderedCache<Key, Value, Weigh>::get(const Key& key, Value& value)
+{
+    Entry* entry = entries_.tryGet(key);
+    if(entry == NULL) {
+        ++counters_.misses;
+        return false;
+    }
+    ++counters_.hits;
+    touch(key, *entry);
+    value = entry->value;
+    return true;
+}
+
+template <typename Key, typename Value, typename Weigh>
+bool OrderedCache<Key, Value, Weigh>::put(const Key& key, const Value& value)
+{
+    size_t weight = weigh_(key, value);
+    if(weight > capacity_) { //would flush everything else and still not fit
+        erase(key);
+        return false;
+    }
+    size_t before = entries_.size();
+    Entry& entry = entries_.getOrCreate(key);
+    if(entries_.size() == before) { //replacing
+        weight_ -= entry.weight;
+    }
+    entry.value = value;
+    entry.weight = weight;
+    weight_ += weight;
+    touch(key, entry);
+    if(weight_ <= capacity_) {
+        return true;
+    }
+    evictToFit();
+    return entries_.tryGet(key) != NULL;
+}
+
+template <typename Key, typename Value, typename Weigh>
+bool OrderedCache<Key, Value, Weigh>::erase(const Key& key)
+{
+    Entry* entry = entries_.tryGet(key);
+    if(entry == NULL) {
+        return false;
+    }
+    weight_ -= entry->weight;
+    if(ranked()) {
+        ranks_.erase(Rank(entry->uses, entry->tick));
+    }
+    entries_.remove(key);
+    return true;
+}
+
+template <typename Key, typename Value, typename Weigh>
+bool OrderedCache<Key, Value, Weigh>::contains(const Key& key) const
+{
+    return entries_.tryGet(key) != NULL;
+}
+
+template <typename Key, typename Value, typename Weigh>
+template <typename Fn>
+void OrderedCache<Key, Value, Weigh>::scan(const Key& lo, const Key& hi, Fn fn) const
+{
+    for(typename AVLTree<Key, Entry>::iterator it = entries_.lowerBound(lo); it != entries_.end() && it->first < hi; ++it) {
+        fn(it->first, it->second.value);
+    }
+}
+
+template <typename Key, typename Value, typename Weigh>
+void OrderedCache<Key, Value, Weigh>::setCapacity(size_t capacity)
+{
+    capacity_ = capacity;
+    evictToFit();
+}
+
+template <typename Key, typename Value, typename Weigh>
+void OrderedCache<Key, Value, Weigh>::clear()
+{
+    entries_.clear();
+    ranks_.clear();
+    weight_ = 0;
+}
+
+/**
+* Records a use of entry: moves it to the most recent end of the eviction
+* order, and for LFU also counts it. A new entry (tick 0) has no rank yet.
+*/
+template <typename Key, typename Value, typename Weigh>
+void OrderedCache<Key, Value, Weigh>::touch(const Key& key, Entry& entry)
+{
+    if(!ranked()) {
+        return;
+    }
+    if(entry.tick != 0) {
+        ranks_.erase(Rank(entry.uses, entry.tick));
+    }
+    if(policy_ == EVICT_LFU) {
+        ++entry.uses;
+    }
+    entry.tick = ++clock_;
+    ranks_.insert(ranks_.end(), std::make_pair(Rank(entry.uses, entry.tick), key));
+}
+
+template <typename Key, typename Value, typename Weigh>
+void OrderedCache<Key, Value, Weigh>::evictToFit()
+{
+    while(weight_ > capacity_ && !entries_.empty()) {
+        if(ranked()) {
+            typename std::map<Rank, Key>::iterator victim = ranks_.begin();
+            weight_ -= entries_.tryGet(victim->second)->weight;
+            entries_.remove(victim->second);
+            ranks_.erase(victim);
+        }
+        else if(policy_ == EVICT_SMALLEST_KEY) {
+            weight_ -= entries_.popMin().second.weight;
+        }
+        else {
+            weight_ -= entries_.popMax().second.weight;
+        }
+        ++counters_.evictions;
+    }
+}
+
+#endif
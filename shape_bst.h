@@ -0,0 +1,235 @@
+#ifndef SHAPE_BST_H
+#define SHAPE_BST_H
+
+#include <sstream>
+#include <string>
+
+// Shape analysis and streaming export for BinarySearchTree.
+// Unlike prettyPrintBST these work on trees of any size: every walk is
+// iterative, uses O(height) memory and writes output as it goes.
+
+// Renders a key or value with operator<< and escapes it for a quoted
+// DOT or JSON string.
+template<typename T>
+std::string shapeQuote(const T& item)
+{
+    std::ostringstream text;
+    text << item;
+    std::string raw = text.str();
+    std::string quoted = "\"";
+    for(size_t i = 0; i < raw.size(); ++i)
+    {
+        char c = raw[i];
+        if(c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if(c == '\n')
+        {
+            quoted += "\\n";
+        }
+        else if((unsigned char)c >= 0x20)
+        {
+            quoted += c;
+        }
+    }
+    quoted += '"';
+    return quoted;
+}
+
+/**
+* One pass over the whole tree: depth histogram, average and maximum path
+* length, distribution of (height(right) - height(left)), leaves and an
+* estimate of the memory the nodes take. O(n) time, O(height) space.
+*/
+template<typename Key, typename Value>
+TreeShape BinarySearchTree<Key, Value>::analyzeShape() const
+{
+	TreeShape shape;
+	// post-order walk: a frame keeps its left subtree's height until the right one is done
+	struct Frame {
+		Node<Key, Value>* node;
+		size_t depth;
+		size_t leftHeight;
+		int state;
+	};
+	std::vector<Frame> stack;
+	if ( root_ != NULL ) {
+		Frame top = { root_, 0, 0, 0 };
+		stack.push_back(top);
+	}
+	size_t childHeight = 0; //height of the subtree finished last
+	double depthSum = 0;
+	while ( !stack.empty() ) {
+		Frame& f = stack.back();
+		if ( f.state == 0 ) { //first visit
+			++shape.nodes;
+			depthSum += f.depth;
+			if ( shape.depthHistogram.size() <= f.depth ) {
+				shape.depthHistogram.resize(f.depth + 1, 0);
+			}
+			++shape.depthHistogram[f.depth];
+			if ( f.node->getLeft() == NULL && f.node->getRight() == NULL ) {
+				++shape.leaves;
+			}
+			f.state = 1;
+			if ( f.node->getLeft() != NULL ) {
+				Frame child = { f.node->getLeft(), f.depth + 1, 0, 0 };
+				stack.push_back(child); //f is invalid from here on
+				continue;
+			}
+			childHeight = 0;
+		}
+		if ( f.state == 1 ) { //left subtree done
+			f.leftHeight = childHeight;
+			f.state = 2;
+			if ( f.node->getRight() != NULL ) {
+				Frame child = { f.node->getRight(), f.depth + 1, 0, 0 };
+				stack.push_back(child);
+				continue;
+			}
+			childHeight = 0;
+		}
+		//both subtrees done
+		++shape.balanceFactors[(int)childHeight - (int)f.leftHeight];
+		childHeight = 1 + std::max(childHeight, f.leftHeight);
+		stack.pop_back();
+	}
+	shape.height = shape.depthHistogram.size();
+	shape.averageDepth = shape.nodes ? depthSum / shape.nodes : 0.0;
+	shape.bytes = shape.nodes * nodeFootprint() + sizeof(*this);
+	return shape;
+}
+
+/**
+* Counts the nodes and the height of the subtree at top without recursing.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::measureSubtree(Node<Key, Value>* top, size_t& nodes, size_t& height)
+{
+	nodes = 0;
+	height = 0;
+	std::vector<std::pair<Node<Key, Value>*, size_t> > stack;
+	if ( top != NULL ) {
+		stack.push_back(std::make_pair(top, (size_t)1));
+	}
+	while ( !stack.empty() ) {
+		Node<Key, Value>* current = stack.back().first;
+		size_t level = stack.back().second;
+		stack.pop_back();
+		++nodes;
+		height = std::max(height, level);
+		if ( current->getLeft() != NULL ) {
+			stack.push_back(std::make_pair(current->getLeft(), level + 1));
+		}
+		if ( current->getRight() != NULL ) {
+			stack.push_back(std::make_pair(current->getRight(), level + 1));
+		}
+	}
+}
+
+/**
+* Writes the tree as a Graphviz digraph. With levels >= 0 only the top levels
+* are drawn and every subtree hanging below them becomes one box giving its node
+* count and height; levels < 0 draws the whole tree. Lines end in '\n' without
+* flushing; flush out when done.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportDot(std::ostream& out, int levels) const
+{
+	struct Frame {
+		Node<Key, Value>* node;
+		int depth;
+		size_t parent;  //id of the parent, or 0 for the root
+		const char* port;
+	};
+	out << "digraph BST {" << '\n';
+	out << "    node [shape=ellipse];" << '\n';
+	std::vector<Frame> stack;
+	if ( root_ != NULL ) {
+		Frame top = { root_, 0, 0, "" };
+		stack.push_back(top);
+	}
+	size_t nextId = 1;
+	while ( !stack.empty() ) {
+		Frame f = stack.back();
+		stack.pop_back();
+		size_t id = nextId++;
+		if ( levels >= 0 && f.depth >= levels ) { //summarize the rest of this subtree
+			size_t nodes, height;
+			measureSubtree(f.node, nodes, height);
+			out << "    n" << id << " [shape=box, label=\"" << nodes << " nodes\\nheight " << height << "\"];" << '\n';
+		}
+		else {
+			out << "    n" << id << " [label=" << shapeQuote(f.node->getKey()) << "];" << '\n';
+			if ( f.node->getRight() != NULL ) {
+				Frame child = { f.node->getRight(), f.depth + 1, id, ":se" };
+				stack.push_back(child);
+			}
+			if ( f.node->getLeft() != NULL ) {
+				Frame child = { f.node->getLeft(), f.depth + 1, id, ":sw" };
+				stack.push_back(child);
+			}
+		}
+		if ( f.parent != 0 ) {
+			out << "    n" << f.parent << f.port << " -> n" << id << ";" << '\n';
+		}
+	}
+	out << "}" << '\n';
+}
+
+/**
+* Writes the tree as nested JSON objects:
+*   {"key": "...", "value": "...", "left": <node or null>, "right": <node or null>}
+* Keys and values are written as strings. With levels >= 0, subtrees below the
+* top levels are written as {"summary": {"nodes": n, "height": h}}.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportJson(std::ostream& out, int levels) const
+{
+	// a frame is entered (state 0), then after its left child (1) and its right child (2)
+	struct Frame {
+		Node<Key, Value>* node;
+		int depth;
+		int state;
+	};
+	std::vector<Frame> stack;
+	Frame top = { root_, 0, 0 };
+	stack.push_back(top);
+	while ( !stack.empty() ) {
+		Frame& f = stack.back();
+		if ( f.state == 0 ) {
+			if ( f.node == NULL ) {
+				out << "null";
+				stack.pop_back();
+			}
+			else if ( levels >= 0 && f.depth >= levels ) {
+				size_t nodes, height;
+				measureSubtree(f.node, nodes, height);
+				out << "{\"summary\": {\"nodes\": " << nodes << ", \"height\": " << height << "}}";
+				stack.pop_back();
+			}
+			else {
+				out << "{\"key\": " << shapeQuote(f.node->getKey())
+				    << ", \"value\": " << shapeQuote(f.node->getValue()) << ", \"left\": ";
+				f.state = 1;
+				Frame child = { f.node->getLeft(), f.depth + 1, 0 };
+				stack.push_back(child); //f is invalid from here on
+			}
+		}
+		else if ( f.state == 1 ) {
+			out << ", \"right\": ";
+			f.state = 2;
+			Frame child = { f.node->getRight(), f.depth + 1, 0 };
+			stack.push_back(child);
+		}
+		else {
+			out << "}";
+			stack.pop_back();
+		}
+	}
+	out << '\n';
+}
+
+#endif
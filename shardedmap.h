@@ -0,0 +1,506 @@
+#ifndef SHARDEDMAP_H
+#define SHARDEDMAP_H
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <pthread.h>
+#include "avlbst.h"
+
+/**
+* A reader-writer lock over pthread_rwlock_t (std::shared_mutex needs C++17).
+* On glibc writers are preferred, so a steady stream of readers cannot starve
+* a writer or a shard split.
+*/
+class ReadWriteLock
+{
+public:
+    ReadWriteLock();
+    ~ReadWriteLock() { pthread_rwlock_destroy(&lock_); }
+
+    void lockShared() { pthread_rwlock_rdlock(&lock_); }
+    void unlockShared() { pthread_rwlock_unlock(&lock_); }
+    void lock() { pthread_rwlock_wrlock(&lock_); }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+
+private:
+    pthread_rwlock_t lock_;
+
+    ReadWriteLock(const ReadWriteLock&);
+    ReadWriteLock& operator=(const ReadWriteLock&);
+};
+
+inline ReadWriteLock::ReadWriteLock()
+{
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int error = pthread_rwlock_init(&lock_, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if(error != 0) {
+        throw std::runtime_error(std::string("cannot create rwlock: ") + strerror(error));
+    }
+}
+
+/**
+* An ordered map for many threads: the key space is cut into range shards, each
+* an AVLTree behind its own ReadWriteLock, so operations on different shards
+* never wait for each other. Point operations lock exactly one shard. Scans
+* visit the shards in key order, holding one shard's read lock at a time: each
+* shard is seen consistently, the whole range is not a snapshot.
+*
+* Shards can be split and merged while other threads use the map. The routing
+* table is immutable and swapped atomically; an operation that routed with an
+* old table finds out under the shard lock that the shard no longer covers its
+* key and routes again. Replaced tables and merged-away shards are kept until
+* the map is destroyed, so a stale pointer is never dangling.
+*/
+template <typename Key, typename Value>
+class ShardedOrderedMap
+{
+public:
+    // Shards are cut at splitKeys, which must be strictly increasing; none gives one shard
+    explicit ShardedOrderedMap(const std::vector<Key>& splitKeys = std::vector<Key>());
+    ~ShardedOrderedMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    // Copies the value out under the shard's read lock
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    // Runs fn on the value (default-constructed if new) under the shard's write lock
+    template <typename Fn>
+    void upsert(const Key& key, Fn fn);
+    size_t size() const;
+
+    // Calls fn(item) for every item with lo <= key < hi, in key order
+    template <typename Fn>
+    void scan(const Key& lo, const Key& hi, Fn fn) const;
+    // Calls fn(item) for every item, in key order
+    template <typename Fn>
+    void forEach(Fn fn) const;
+
+    size_t shardCount() const;
+    void shardSizes(std::vector<size_t>& sizes) const;
+    // Splits shard index near its median key; false if it has fewer than 2 items
+    bool splitShard(size_t index);
+    // Merges shard index + 1 into shard index
+    void mergeShards(size_t index);
+    // Splits the shard with the most operations since the last call, unless
+    // there are already maxShards shards
+    bool splitHottest(size_t maxShards);
+
+private:
+    // An AVLTree that can name the key at its root, which splits it about in half
+    class ShardTree : public AVLTree<Key, Value>
+    {
+    public:
+        const Key* middleKey() const;
+    };
+
+    struct Shard
+    {
+        ShardTree tree;
+        ReadWriteLock lock;
+        Key* low;      // inclusive lower bound, NULL for the first shard; guarded by lock
+        Key* high;     // exclusive upper bound, NULL for the last shard; guarded by lock
+        bool retired;  // merged into its left neighbour; guarded by lock
+        std::atomic<uint64_t> ops;
+
+        Shard() : low(NULL), high(NULL), retired(false), ops(0) { }
+        ~Shard() { delete low; delete high; }
+        bool covers(const Key& key) const;
+    };
+
+    struct Table
+    {
+        std::vector<Shard*> shards;
+        std::vector<Key> splits;  // splits[i] is the lower bound of shards[i + 1]
+    };
+
+    Shard* route(const Key& key) const;
+    Shard* lockShared(const Key& key) const;
+    Shard* lockExclusive(const Key& key);
+    template <typename Fn>
+    void visitShards(const Key* from, Fn fn) const;
+    bool splitLocked(size_t index);
+    void publish(Table* next);
+
+    std::atomic<Table*> table_;
+    mutable std::mutex reshard_;       // serializes splits and merges, and holds them off size()
+    std::vector<Table*> oldTables_;    // guarded by reshard_
+    std::vector<Shard*> retired_;      // guarded by reshard_
+
+    ShardedOrderedMap(const ShardedOrderedMap&);
+    ShardedOrderedMap& operator=(const ShardedOrderedMap&);
+};
+
+template <typename Key, typename Value>
+const Key* ShardedOrderedMap<Key, Value>::ShardTree::middleKey() const
+{
+    Node<Key, Value>* root = this->root_;
+    if(root == NULL) {
+        return NULL;
+    }
+    if(root->getLeft() != NULL) {
+        return &root->getKey();
+    }
+    if(root->getRight() != NULL) { //root is the minimum, so cut above it
+        return &root->getRight()->getKey();
+    }
+    return NULL;
+}
+
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::Shard::covers(const Key& key) const
+{
+    return !retired && (low == NULL || !(key < *low)) && (high == NULL || key < *high);
+}
+
+template <typename Key, typename Value>
+ShardedOrderedMap<Key, Value>::ShardedOrderedMap(const std::vector<Key>& splitKeys)
+{
+    for(size_t i = 1; i < splitKeys.size(); ++i) {
+        if(!(splitKeys[i - 1] < splitKeys[i])) {
+            throw std::invalid_argument("ShardedOrderedMap needs strictly increasing split keys");
+        }
+    }
+    Table* table = new Table;
+    table->splits = splitKeys;
+    for(size_t i = 0; i <= splitKeys.size(); ++i) {
+        Shard* shard = new Shard;
+        if(i > 0) {
+            shard->low = new Key(splitKeys[i - 1]);
+        }
+        if(i < splitKeys.size()) {
+            shard->high = new Key(splitKeys[i]);
+        }
+        table->shards.push_back(shard);
+    }
+    table_.store(table);
+}
+
+template <typename Key, typename Value>
+ShardedOrderedMap<Key, Value>::~ShardedOrderedMap()
+{
+    Table* table = table_.load();
+    for(size_t i = 0; i < table->shards.size(); ++i) {
+        delete table->shards[i];
+    }
+    delete table;
+    for(size_t i = 0; i < oldTables_.size(); ++i) {
+        delete oldTables_[i];
+    }
+    for(size_t i = 0; i < retired_.size(); ++i) {
+        delete retired_[i];
+    }
+}
+
+/**
+* The shard the current table sends key to. It may be stale by the time it is
+* locked; callers check covers() under the lock.
+*/
+template <typename Key, typename Value>
+typename ShardedOrderedMap<Key, Value>::Shard* ShardedOrderedMap<Key, Value>::route(const Key& key) const
+{
+    const Table* table = table_.load(std::memory_order_acquire);
+    size_t index = std::upper_bound(table->splits.begin(), table->splits.end(), key) - table->splits.begin();
+    return table->shards[index];
+}
+
+template <typename Key, typename Value>
+typename ShardedOrderedMap<Key, Value>::Shard* ShardedOrderedMap<Key, Value>::lockShared(const Key& key) const
+{
+    for(;;) {
+        Shard* shard = route(key);
+        shard->lock.lockShared();
+        if(shard->covers(key)) {
+            shard->ops.fetch_add(1, std::memory_order_relaxed);
+            return shard;
+        }
+        shard->lock.unlockShared(); //split or merged since we routed
+    }
+}
+
+template <typename Key, typename Value>
+typename ShardedOrderedMap<Key, Value>::Shard* ShardedOrderedMap<Key, Value>::lockExclusive(const Key& key)
+{
+    for(;;) {
+        Shard* shard = route(key);
+        shard->lock.lock();
+        if(shard->covers(key)) {
+            shard->ops.fetch_add(1, std::memory_order_relaxed);
+            return shard;
+        }
+        shard->lock.unlock();
+    }
+}
+
+template <typename Key, typename Value>
+void ShardedOrderedMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Shard* shard = lockExclusive(keyValuePair.first);
+    try {
+        shard->tree.insert(keyValuePair);
+    }
+    catch(...) {
+        shard->lock.unlock();
+        throw;
+    }
+    shard->lock.unlock();
+}
+
+template <typename Key, typename Value>
+void ShardedOrderedMap<Key, Value>::remove(const Key& key)
+{
+    Shard* shard = lockExclusive(key);
+    shard->tree.remove(key);
+    shard->lock.unlock();
+}
+
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::find(const Key& key, Value& value) const
+{
+    Shard* shard = lockShared(key);
+    const Value* found = shard->tree.tryGet(key);
+    if(found != NULL) {
+        value = *found;
+    }
+    shard->lock.unlockShared();
+    return found != NULL;
+}
+
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::contains(const Key& key) const
+{
+    Shard* shard = lockShared(key);
+    bool found = shard->tree.tryGet(key) != NULL;
+    shard->lock.unlockShared();
+    return found;
+}
+
+template <typename Key, typename Value>
+template <typename Fn>
+void ShardedOrderedMap<Key, Value>::upsert(const Key& key, Fn fn)
+{
+    Shard* shard = lockExclusive(key);
+    try {
+        shard->tree.upsert(key, fn);
+    }
+    catch(...) {
+        shard->lock.unlock();
+        throw;
+    }
+    shard->lock.unlock();
+}
+
+/**
+* Calls fn(shard, from) for the shard covering *from (the first shard if from
+* is NULL) and every shard after it, in key order, each under its read lock;
+* fn returns false to stop. Each shard is found from the previous one's upper
+* bound and passed that bound as from: after a concurrent merge the shard may
+* also hold keys below it, which were visited already and must be skipped.
+*/
+template <typename Key, typename Value>
+template <typename Fn>
+void ShardedOrderedMap<Key, Value>::visitShards(const Key* from, Fn fn) const
+{
+    Shard* shard;
+    if(from != NULL) {
+        shard = lockShared(*from);
+    }
+    else { //the first shard is never merged away, so it never has to be re-routed
+        shard = table_.load(std::memory_order_acquire)->shards[0];
+        shard->lock.lockShared();
+    }
+    std::vector<Key> bound; //holds the key from points to once we have moved past the first shard
+    for(;;) {
+        bool more;
+        try {
+            more = fn(*shard, from) && shard->high != NULL;
+        }
+        catch(...) {
+            shard->lock.unlockShared();
+            throw;
+        }
+        if(!more) {
+            shard->lock.unlockShared();
+            return;
+        }
+        bound.assign(1, *shard->high);
+        from = &bound[0];
+        shard->lock.unlockShared();
+        shard = lockShared(*from);
+    }
+}
+
+template <typename Key, typename Value>
+template <typename Fn>
+void ShardedOrderedMap<Key, Value>::scan(const Key& lo, const Key& hi, Fn fn) const
+{
+    if(!(lo < hi)) {
+        return;
+    }
+    visitShards(&lo, [&](const Shard& shard, const Key* from) {
+        typename AVLTree<Key, Value>::iterator it = shard.tree.lowerBound(*from);
+        for( ; it != shard.tree.end() && it->first < hi; ++it) {
+            fn(*it);
+        }
+        return shard.high != NULL && *shard.high < hi;
+    });
+}
+
+template <typename Key, typename Value>
+template <typename Fn>
+void ShardedOrderedMap<Key, Value>::forEach(Fn fn) const
+{
+    visitShards(NULL, [&](const Shard& shard, const Key* from) {
+        typename AVLTree<Key, Value>::iterator it = from != NULL ? shard.tree.lowerBound(*from) : shard.tree.begin();
+        for( ; it != shard.tree.end(); ++it) {
+            fn(*it);
+        }
+        return true;
+    });
+}
+
+/**
+* Sums the shard sizes one shard at a time, so it is exact only while no other
+* thread is writing. Resharding waits, so no shard is counted twice.
+*/
+template <typename Key, typename Value>
+size_t ShardedOrderedMap<Key, Value>::size() const
+{
+    std::lock_guard<std::mutex> guard(reshard_);
+    size_t total = 0;
+    visitShards(NULL, [&](const Shard& shard, const Key*) {
+        total += shard.tree.size();
+        return true;
+    });
+    return total;
+}
+
+template <typename Key, typename Value>
+size_t ShardedOrderedMap<Key, Value>::shardCount() const
+{
+    return table_.load(std::memory_order_acquire)->shards.size();
+}
+
+template <typename Key, typename Value>
+void ShardedOrderedMap<Key, Value>::shardSizes(std::vector<size_t>& sizes) const
+{
+    std::lock_guard<std::mutex> guard(reshard_);
+    sizes.clear();
+    visitShards(NULL, [&](const Shard& shard, const Key*) {
+        sizes.push_back(shard.tree.size());
+        return true;
+    });
+}
+
+template <typename Key, typename Value>
+void ShardedOrderedMap<Key, Value>::publish(Table* next)
+{
+    oldTables_.push_back(table_.load());
+    table_.store(next, std::memory_order_release);
+}
+
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::splitShard(size_t index)
+{
+    std::lock_guard<std::mutex> guard(reshard_);
+    return splitLocked(index);
+}
+
+/**
+* Moves the upper half of shard index into a new shard. Only that shard is
+* blocked, for the O(log n) AVLTree::split plus counting the moved items.
+*/
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::splitLocked(size_t index)
+{
+    const Table* table = table_.load();
+    if(index >= table->shards.size()) {
+        throw std::out_of_range("splitShard index out of range");
+    }
+    Shard* shard = table->shards[index];
+    Table* next = new Table(*table);
+    Shard* upper = new Shard;
+    shard->lock.lock();
+    const Key* found = shard->tree.middleKey();
+    if(found == NULL) {
+        shard->lock.unlock();
+        delete upper;
+        delete next;
+        return false;
+    }
+    Key middle(*found);
+    shard->tree.split(middle, upper->tree);
+    upper->low = new Key(middle);
+    upper->high = shard->high;
+    shard->high = new Key(middle);
+    next->shards.insert(next->shards.begin() + index + 1, upper);
+    next->splits.insert(next->splits.begin() + index, middle);
+    publish(next); //before the unlock, so a retry after it routes with the new table
+    shard->lock.unlock();
+    return true;
+}
+
+/**
+* Joins shard index + 1 onto shard index in O(log n) and retires it. Both are
+* write-locked, left first; no other path holds two shard locks at once.
+*/
+template <typename Key, typename Value>
+void ShardedOrderedMap<Key, Value>::mergeShards(size_t index)
+{
+    std::lock_guard<std::mutex> guard(reshard_);
+    const Table* table = table_.load();
+    if(index + 1 >= table->shards.size()) {
+        throw std::out_of_range("mergeShards index out of range");
+    }
+    Shard* left = table->shards[index];
+    Shard* right = table->shards[index + 1];
+    Table* next = new Table(*table);
+    next->shards.erase(next->shards.begin() + index + 1);
+    next->splits.erase(next->splits.begin() + index);
+    left->lock.lock();
+    right->lock.lock();
+    left->tree.join(right->tree);
+    delete left->high;
+    left->high = right->high;
+    right->high = NULL;
+    right->retired = true;
+    left->ops.fetch_add(right->ops.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    publish(next);
+    right->lock.unlock();
+    left->lock.unlock();
+    retired_.push_back(right);
+}
+
+template <typename Key, typename Value>
+bool ShardedOrderedMap<Key, Value>::splitHottest(size_t maxShards)
+{
+    std::lock_guard<std::mutex> guard(reshard_);
+    const Table* table = table_.load();
+    size_t hottest = 0;
+    uint64_t most = 0;
+    for(size_t i = 0; i < table->shards.size(); ++i) {
+        uint64_t ops = table->shards[i]->ops.exchange(0, std::memory_order_relaxed);
+        if(ops > most) {
+            most = ops;
+            hottest = i;
+        }
+    }
+    if(most == 0 || table->shards.size() >= maxShards) {
+        return false;
+    }
+    return splitLocked(hottest);
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <utility>
+#include "epoch.h"
+
+/**
+* A lock-free ordered map with the insert/remove/find/begin/end surface of
+* BinarySearchTree, for paths where many threads write at once and none may
+* block. It is a skip list whose links carry a "deleted" mark in their low bit
+* (Fraser's design): remove() marks a node's links top-down, the level 0 mark
+* is the point where it is gone, and every traversal helps unlink marked nodes
+* it passes. Each node points to its item through an atomic pointer, so
+* overwriting a key swaps in a new item without locking.
+*
+* Nodes and items are reclaimed with EpochDomain: every operation and every
+* live iterator pins the calling thread's epoch. Iterators are weakly
+* consistent: they never fail and never return an item twice, and they see
+* some of the changes made while they are walking. An iterator pins its thread
+* until it is destroyed, so do not keep one for long, and do not hand it to
+* another thread. Values read through an iterator are not synchronized with
+* writers of the same item; insert() publishes a new item instead of writing
+* the old one.
+*/
+template <typename Key, typename Value>
+class ConcurrentSkipListMap
+{
+public:
+    static const int MAX_LEVEL = 32;
+
+    ConcurrentSkipListMap();
+    ~ConcurrentSkipListMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    // Counted at the linearization points, so exact only while no thread is writing
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+    bool empty() const;
+
+private:
+    struct Node
+    {
+        const Key key;
+        std::atomic<std::pair<const Key, Value>*> item;
+        std::atomic<int> handoff;  // the inserter and the remover each add one when done; the second retires
+        int levels;
+        std::atomic<uintptr_t> next[1];  // really next[levels]; the low bit marks the node deleted at that level
+
+        static Node* create(const Key& key, const Value& value, int levels);
+        static void destroy(void* node);
+    private:
+        Node(const Key& k, std::pair<const Key, Value>* i, int l) : key(k), item(i), handoff(0), levels(l) { }
+        ~Node() { }
+    };
+
+public:
+    class iterator
+    {
+    public:
+        iterator() : node_(NULL), pin_(EpochGuard::none()) { }
+
+        std::pair<const Key, Value>& operator*() const { return *node_->item.load(std::memory_order_acquire); }
+        std::pair<const Key, Value>* operator->() const { return node_->item.load(std::memory_order_acquire); }
+
+        bool operator==(const iterator& rhs) const { return node_ == rhs.node_; }
+        bool operator!=(const iterator& rhs) const { return node_ != rhs.node_; }
+
+        iterator& operator++();
+
+    private:
+        friend class ConcurrentSkipListMap<Key, Value>;
+        iterator(Node* node, const EpochGuard& pin) : node_(node), pin_(node != NULL ? pin : EpochGuard::none()) { }
+
+        Node* node_;
+        EpochGuard pin_;
+    };
+
+    iterator begin() const;
+    iterator end() const { return iterator(); }
+    iterator find(const Key& key) const;
+
+private:
+    static bool marked(uintptr_t link) { return (link & 1) != 0; }
+    static Node* pointer(uintptr_t link) { return reinterpret_cast<Node*>(link & ~(uintptr_t)1); }
+    static uintptr_t linkTo(Node* node) { return reinterpret_cast<uintptr_t>(node); }
+
+    std::atomic<uintptr_t>& nextOf(Node* pred, int level) const
+    {
+        return pred == NULL ? head_[level] : pred->next[level];
+    }
+    // Skips nodes that are already deleted at level 0
+    static Node* live(Node* node);
+    bool locate(const Key& key, Node** preds, Node** succs) const;
+    void finish(Node* node);
+    static int randomLevels();
+    static void destroyItem(void* item);
+
+    mutable std::atomic<uintptr_t> head_[MAX_LEVEL];  // next links of the head; NULL is the end at every level
+    std::atomic<size_t> size_;
+
+    ConcurrentSkipListMap(const ConcurrentSkipListMap&);
+    ConcurrentSkipListMap& operator=(const ConcurrentSkipListMap&);
+};
+
+template <typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::Node* ConcurrentSkipListMap<Key, Value>::Node::create(const Key& key, const Value& value, int levels)
+{
+    void* memory = ::operator new(sizeof(Node) + (levels - 1) * sizeof(std::atomic<uintptr_t>));
+    std::pair<const Key, Value>* item = new std::pair<const Key, Value>(key, value);
+    Node* node;
+    try {
+        node = new (memory) Node(key, item, levels);
+    }
+    catch(...) {
+        delete item;
+        ::operator delete(memory);
+        throw;
+    }
+    for(int i = 1; i < levels; ++i) {
+        new (&node->next[i]) std::atomic<uintptr_t>(0);
+    }
+    return node;
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::Node::destroy(void* memory)
+{
+    Node* node = static_cast<Node*>(memory);
+    delete node->item.load(std::memory_order_relaxed);
+    node->~Node();
+    ::operator delete(memory);
+}
+
+template <typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::destroyItem(void* item)
+{
+    delete static_cast<std::pair<const Key, Value>*>(item);
+}
+
+template <typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::ConcurrentSkipListMap() : size_(0)
+{
+    for(int i = 0; i < MAX_LEVEL; ++i) {
+        head_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Not safe against other threads still using the map. Nodes already retired
+* are freed by the epoch domain; the ones still linked are freed here.
+*/
+template <typename Key, typename Value>
+ConcurrentSkipListMap<Key, Value>::~ConcurrentSkipListMap()
+{
+    Node* node = pointer(head_[0].load(std::memory_order_acquire));
+    while(node != NULL) {
+        Node* next = pointer(node->next[0].load(std::memory_order_relaxed));
+        if(!marked(node->next[0].load(std::memory_order_relaxed))) { //a marked node's remover retires it
+            Node::destroy(node);
+        }
+        node = next;
+    }
+}
+
+/**
+* One level above the last with probability 1/4, like Java's
+* ConcurrentSkipListMap: about 1.33 links per node.
+*/
+template <typename Key, typename Value>
+int ConcurrentSkipListMap<Key, Value>::randomLevels()
+{
+    static thread_local uint64_t state = 0;
+    if(state == 0) {
+        state = reinterpret_cast<uintptr_t>(&state) * 0x9E3779B97F4A7C15ULL | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int levels = 1;
+    for(uint64_t bits = state; levels < MAX_LEVEL && (bits & 3) == 0; bits >>= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+/**
+* Fills preds/succs with the last node before key and the first node at or
+* after it on every level (NULL preds mean the head), unlinking every marked
+* node it meets on the way. Returns whether succs[0] holds key.
+*/
+template <typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::locate(const Key& key, Node** preds, Node** succs) const
+{
+retry:
+    Node* pred = NULL;
+    for(int level = MAX_LEVEL - 1; level >= 0; --level) {
+        Node* current = pointer(nextOf(pred, level).load(std::memory_order_acquire));
+        for(;;) {
+            if(current == NULL) {
+                break;
+            }
+            uintptr_t link = current->next[level].load(std::memory_order_acquire);
+            while(marked(link)) { //current is being removed: unlink it here
+                uintptr_t expected = linkTo(current);
+                if(!nextOf(pred, level).compare_exchange_strong(expected, link & ~(uintptr_t)1)) {
+                    goto retry; //pred changed or was marked itself
+                }
+                current = pointer(link);
+                if(current == NULL) {
+                    break;
+                }
+                link = current->next[level].load(std::memory_order_acquire);
+            }
+            if(current == NULL || !(current->key < key)) {
+                break;
+            }
+            pred = current;
+            current = pointer(link);
+        }
+        preds[level] = pred;
+        succs[level] = current;
+    }
+    return succs[0] != NULL && !(key < succs[0]->key);
+}
+
+/**
+* Inserts the pair, or swaps in a new item if the key is already there. The
+* node is live once it is linked at level 0; the upper levels are only an index
+* and are linked afterwards.
+*/
+template <typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    EpochGuard pin;
+    const Key& key = keyValuePair.first;
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+    Node* node = NULL;
+    for(;;) {
+        if(locate(key, preds, succs)) {
+            Node* found = succs[0];
+            std::pair<const Key, Value>* item = new std::pair<const Key, Value>(keyValuePair);
+            std::pair<const Key, Value>* old = found->item.exchange(item, std::memory_order_acq_rel);
+            EpochDomain::instance().retire(old, destroyItem);
+            if(!marked(found->next[0].load(std::memory_order_acquire))) {
+                if(node != NULL) {
+                    Node::destroy(node); //never published
+                }
+                return;
+            }
+            continue; //removed under us: this insert goes after the remove
+        }
+        if(node == NULL) {
+            node = Node::create(key, keyValuePair.second, randomLevels());
+        }
+        for(int i = 0; i < node->levels; ++i) {
+            node->next[i].store(linkTo(succs[i]), std::memory_order_relaxed);
+        }
+        uintptr_t expected = linkTo(succs[0]);
+        if(nextOf(preds[0], 0).compare_exchange_strong(expected, linkTo(node))) {
+            break;
+        }
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    for(int level = 1; level < node->levels; ++level) {
+        for(;;) {
+            uintptr_t link = node->next[level].load(std::memory_order_acquire);
+            if(marked(link)) {
+                goto linked; //already being removed, stop indexing it
+            }
+            if(pointer(link) != succs[level] &&
+               !node->next[level].compare_exchange_strong(link, linkTo(succs[level]))) {
+                goto linked;
+            }
+            uintptr_t expected = linkTo(succs[level]);
+            if(nextOf(preds[level], level).compare_exchange_strong(expected, linkTo(node))) {
+                break;
+            }
+            locate(key, preds, succs); //the neighbourhood changed, look again
+            if(succs[0] != node) {
+                goto linked; //removed and unlinked already
+            }
+        }
+    }
+linked:
+    finish(node);
+}
+
+/**
+* Marks the node's links from the top down; whoever sets the level 0 mark has
+* removed the key.
+*/
+template <typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::remove(const Key& key)
+{
+    EpochGuard pin;
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+    if(!locate(key, preds, succs)) {
+        return;
+    }
+    Node* node = succs[0];
+    for(int level = node->levels - 1; level >= 1; --level) {
+        node->next[level].fetch_or(1, std::memory_order_acq_rel);
+    }
+    uintptr_t before = node->next[0].fetch_or(1, std::memory_order_acq_rel);
+    if(marked(before)) {
+        return; //another remove won
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    finish(node);
+}
+
+/**
+* Called once by the node's inserter when it stops linking levels and once by
+* its remover after marking every level. The second caller sees every link and
+* every mark, so one more locate() unlinks the node for good and it can be
+* retired. Until then traversals that pass it help unlink it.
+*/
+template <typename Key, typename Value>
+void ConcurrentSkipListMap<Key, Value>::finish(Node* node)
+{
+    if(node->handoff.fetch_add(1, std::memory_order_acq_rel) == 1) {
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        locate(node->key, preds, succs);
+        EpochDomain::instance().retire(node, Node::destroy);
+    }
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::Node* ConcurrentSkipListMap<Key, Value>::live(Node* node)
+{
+    while(node != NULL) {
+        uintptr_t link = node->next[0].load(std::memory_order_acquire);
+        if(!marked(link)) {
+            break;
+        }
+        node = pointer(link);
+    }
+    return node;
+}
+
+template <typename Key, typename Value>
+bool ConcurrentSkipListMap<Key, Value>::empty() const
+{
+    EpochGuard pin;
+    return live(pointer(head_[0].load(std::memory_order_acquire))) == NULL;
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator ConcurrentSkipListMap<Key, Value>::begin() const
+{
+    EpochGuard pin;
+    return iterator(live(pointer(head_[0].load(std::memory_order_acquire))), pin);
+}
+
+/**
+* Read-only: steps over marked nodes instead of unlinking them, so lookups
+* never write to shared memory.
+*/
+template <typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator ConcurrentSkipListMap<Key, Value>::find(const Key& key) const
+{
+    EpochGuard pin;
+    Node* pred = NULL;
+    Node* current = NULL;
+    for(int level = MAX_LEVEL - 1; level >= 0; --level) {
+        current = pointer(nextOf(pred, level).load(std::memory_order_acquire));
+        while(current != NULL) {
+            uintptr_t link = current->next[level].load(std::memory_order_acquire);
+            while(marked(link)) {
+                current = pointer(link);
+                if(current == NULL) {
+                    break;
+                }
+                link = current->next[level].load(std::memory_order_acquire);
+            }
+            if(current == NULL || !(current->key < key)) {
+                break;
+            }
+            pred = current;
+            current = pointer(link);
+        }
+    }
+    if(current == NULL || key < current->key) {
+        return end();
+    }
+    return iterator(current, pin);
+}
+
+template <typename Key, typename Value>
+typename ConcurrentSkipListMap<Key, Value>::iterator& ConcurrentSkipListMap<Key, Value>::iterator::operator++()
+{
+    node_ = live(pointer(node_->next[0].load(std::memory_order_acquire)));
+    if(node_ == NULL) {
+        pin_ = EpochGuard::none();
+    }
+    return *this;
+}
+
+#endif